@@ -22,6 +22,12 @@
 /* Extra modifier for resizing. Default is Shift. */
 #define EXTRA_MODKEY (MODKEY | XCB_MOD_MASK_SHIFT)
 
+/* Modifier to put a window on another workspace too. Default is Control. */
+#define TAG_MODKEY (MODKEY | XCB_MOD_MASK_CONTROL)
+
+/* Modifier to move the container of a window. Default is Control + Shift. */
+#define CONTAINER_MODKEY (TAG_MODKEY | XCB_MOD_MASK_SHIFT)
+
 /*
  * Modifier key to use with mouse buttons. Default Mod1, Meta on my
  * keyboard.
@@ -72,6 +78,57 @@
 
 #define GAPWIDTH 2
 
+/*
+ * Flush requests to the X server while handling a burst of events
+ * once this many microseconds passed since the last flush or this
+ * many requests are waiting to be sent.
+ */
+#define FLUSH_BUDGET	2000
+#define FLUSH_REQUESTS	64
+
+/*
+ * Milliseconds to wait for a client to acknowledge a resize with
+ * _NET_WM_SYNC_REQUEST before sending the next one anyway.
+ */
+#define SYNC_TIMEOUT 100
+
+/*
+ * Move and resize windows as an outline and only change the real
+ * window when done. Can also be set by calling wmwm with -o.
+ */
+#define OUTLINE false
+
+/*
+ * Put each window into a frame window of its own, which draws the
+ * border. Otherwise the border is the window's own and only shaped
+ * windows get a frame. Can also be turned off by calling wmwm with -n.
+ */
+#define REPARENT true
+
+/*
+ * Frame windows kept for new windows instead of destroying them, to
+ * save creating one for each short lived dialog or popup.
+ */
+#define FRAME_POOL 8
+
+/*
+ * Milliseconds after the last keyboard move or resize step an
+ * outline is applied to the window.
+ */
+#define OUTLINE_DELAY 500
+
+/*
+ * Refresh rate in Hz to pace dragging windows with, if RANDR doesn't
+ * tell us the rate of the monitor.
+ */
+#define DRAG_RATE 60
+
+/*
+ * Milliseconds the pointer has to stay over a window before it gets
+ * the focus, 0 to focus right away. Can be set with "-d ms".
+ */
+#define FOCUS_DELAY 0
+
 /*
  * Keysym codes for window operations. Look in X11/keysymdefs.h for
  * actual symbols.
@@ -45,6 +45,40 @@ void list_to_head(list_t **mainlist, list_t *item)
 	*mainlist = item;
 }
 
+/*
+ * Move item right behind after in mainlist, to the head if after is
+ * NULL.
+ */
+void list_move_after(list_t **mainlist, list_t *after, list_t *item)
+{
+	if (NULL == item || NULL == mainlist || NULL == *mainlist)
+		return;
+
+	if (NULL == after) {
+		list_to_head(mainlist, item);
+		return;
+	}
+
+	/* Already there, or after itself. */
+	if (item->prev == after || item == after)
+		return;
+
+	/* Braid together the list where we are now. */
+	if (*mainlist == item)
+		*mainlist = item->next;
+	if (item->prev)
+		item->prev->next = item->next;
+	if (item->next)
+		item->next->prev = item->prev;
+
+	/* And into the new place. */
+	item->prev = after;
+	item->next = after->next;
+	if (after->next)
+		after->next->prev = item;
+	after->next = item;
+}
+
 /*
  * Create space for a new item and add it to the head of mainlist.
  *
@@ -83,6 +117,8 @@ void list_remove(list_t **mainlist, list_t *item)
 	if (item == *mainlist) {
 		/* First entry was removed. Remember the next one instead. */
 		*mainlist = ml->next;
+		if (*mainlist)
+			(*mainlist)->prev = NULL;
 	} else {
 		item->prev->next = item->next;
 
@@ -14,6 +14,12 @@ struct list_item {
  */
 void list_to_head(list_t **mainlist, list_t *item);
 
+/*
+ * Move item right behind after in mainlist, to the head if after is
+ * NULL.
+ */
+void list_move_after(list_t **mainlist, list_t *after, list_t *item);
+
 /*
  * Create space for a new item and add it to the head of mainlist.
  *
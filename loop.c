@@ -0,0 +1,405 @@
+#define _POSIX_C_SOURCE 200809L
+#include "loop.h"
+#include <assert.h>        // for assert
+#include <errno.h>         // for EINTR, EAGAIN, errno
+#include <signal.h>        // for sigset_t, sigprocmask, sigaddset
+#include <stdio.h>         // for fprintf, stderr
+#include <stdlib.h>        // for calloc, realloc, free
+#include <string.h>        // for memset
+#include <time.h>          // for clock_gettime, timespec
+#include <unistd.h>        // for read, close
+#include <sys/epoll.h>     // for epoll_create1, epoll_ctl, epoll_wait
+#include <sys/signalfd.h>  // for signalfd, signalfd_siginfo
+#include <sys/timerfd.h>   // for timerfd_create, timerfd_settime
+
+#include "list.h"          // for list_t, list_add, list_erase
+
+#ifdef DEBUGMSG
+#define PDEBUG(Args...) \
+	do { fprintf(stderr, "loop: "); fprintf(stderr, ##Args); } while(0)
+#define D(x) x
+#else
+#define PDEBUG(Args...)
+#define D(x)
+#endif
+
+#define destroy(x) do { free(x); x = NULL; } while (0)
+
+/* events fetched per epoll_wait */
+#define LOOP_EVENTS 16
+
+/* file descriptor watch */
+struct watch {
+	int fd;
+	loop_fd_cb cb;
+	void *arg;
+	bool dead;		/* removed while dispatching, free afterwards */
+	list_t *item;	/* our place in the watch list */
+};
+
+/* timer in heap */
+struct timer {
+	uint64_t deadline;
+	uint64_t interval;
+	loop_timer_cb cb;
+	void *arg;
+	loop_timer_t id;
+};
+
+static struct {
+	int epfd;
+	int sigfd;
+	int timerfd;
+
+	sigset_t sigmask;		/* signals we deliver via sigfd */
+	loop_signal_cb sigcb;
+	void *sigarg;
+
+	list_t *watches;
+	bool dispatching;
+
+	struct timer *heap;		/* min-heap of timers by deadline */
+	unsigned timers;
+	unsigned heap_len;
+	loop_timer_t last_id;
+	uint64_t armed;			/* deadline timerfd is set to, 0 if none */
+} loop = { .epfd = -1, .sigfd = -1, .timerfd = -1 };
+
+uint64_t loop_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* TIMERS ***********************************************************/
+
+static void heap_swap(unsigned a, unsigned b)
+{
+	struct timer tmp = loop.heap[a];
+	loop.heap[a] = loop.heap[b];
+	loop.heap[b] = tmp;
+}
+
+static void heap_up(unsigned i)
+{
+	while (i > 0) {
+		unsigned parent = (i - 1) / 2;
+		if (loop.heap[parent].deadline <= loop.heap[i].deadline)
+			break;
+		heap_swap(parent, i);
+		i = parent;
+	}
+}
+
+static void heap_down(unsigned i)
+{
+	for (;;) {
+		unsigned min = i;
+		unsigned l = 2 * i + 1;
+		unsigned r = 2 * i + 2;
+
+		if (l < loop.timers && loop.heap[l].deadline < loop.heap[min].deadline)
+			min = l;
+		if (r < loop.timers && loop.heap[r].deadline < loop.heap[min].deadline)
+			min = r;
+		if (min == i)
+			break;
+		heap_swap(min, i);
+		i = min;
+	}
+}
+
+static bool heap_push(struct timer t)
+{
+	if (loop.timers == loop.heap_len) {
+		unsigned len = loop.heap_len ? loop.heap_len * 2 : 8;
+		struct timer *tmp = realloc(loop.heap, len * sizeof(struct timer));
+		if (tmp == NULL)
+			return false;
+		loop.heap = tmp;
+		loop.heap_len = len;
+	}
+	loop.heap[loop.timers] = t;
+	heap_up(loop.timers++);
+	return true;
+}
+
+static void heap_remove(unsigned i)
+{
+	assert(i < loop.timers);
+
+	if (i != --loop.timers) {
+		loop.heap[i] = loop.heap[loop.timers];
+		heap_up(i);
+		heap_down(i);
+	}
+}
+
+/* arm timerfd to the earliest deadline, if that changed */
+static void timer_rearm()
+{
+	const uint64_t next = loop.timers ? loop.heap[0].deadline : 0;
+	struct itimerspec its;
+
+	if (next == loop.armed)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	if (next) {
+		its.it_value.tv_sec  = next / 1000000u;
+		its.it_value.tv_nsec = (next % 1000000u) * 1000u;
+	}
+	/* a zero it_value disarms */
+	timerfd_settime(loop.timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+	loop.armed = next;
+}
+
+loop_timer_t loop_timer_add(uint64_t usec, uint64_t interval,
+		loop_timer_cb cb, void *arg)
+{
+	struct timer t;
+
+	assert(cb != NULL);
+
+	/* skip 0 on wrap-around */
+	if (++loop.last_id == 0)
+		++loop.last_id;
+
+	t.deadline = loop_now() + usec;
+	t.interval = interval;
+	t.cb = cb;
+	t.arg = arg;
+	t.id = loop.last_id;
+
+	if (! heap_push(t))
+		return 0;
+
+	timer_rearm();
+	return t.id;
+}
+
+static int timer_find(loop_timer_t timer)
+{
+	for (unsigned i = 0; i < loop.timers; i++) {
+		if (loop.heap[i].id == timer)
+			return i;
+	}
+	return -1;
+}
+
+void loop_timer_cancel(loop_timer_t timer)
+{
+	int i;
+
+	if (timer == 0 || (i = timer_find(timer)) < 0)
+		return;
+
+	heap_remove(i);
+	timer_rearm();
+}
+
+bool loop_timer_pending(loop_timer_t timer)
+{
+	return (timer != 0 && timer_find(timer) >= 0);
+}
+
+/* fire all expired timers */
+static void timer_expired(int fd, uint32_t events, void *arg)
+{
+	uint64_t expirations;
+	(void)events; (void)arg;
+
+	/* nothing to read if we got here because of an early rearm */
+	if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		perror("loop timerfd");
+
+	const uint64_t now = loop_now();
+
+	while (loop.timers > 0 && loop.heap[0].deadline <= now) {
+		struct timer t = loop.heap[0];
+
+		if (t.interval) {
+			/* keep the phase, skip missed ticks */
+			while (loop.heap[0].deadline <= now)
+				loop.heap[0].deadline += t.interval;
+			heap_down(0);
+		} else {
+			heap_remove(0);
+		}
+		/* callback might add or cancel timers, including this one */
+		t.cb(t.arg);
+	}
+	/* force a rearm, the timerfd is expired now */
+	loop.armed = 0;
+	timer_rearm();
+}
+
+/* SIGNALS **********************************************************/
+
+static void signal_read(int fd, uint32_t events, void *arg)
+{
+	struct signalfd_siginfo si;
+	(void)events; (void)arg;
+
+	while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+		PDEBUG("signal %u\n", si.ssi_signo);
+		if (loop.sigcb)
+			loop.sigcb(si.ssi_signo, loop.sigarg);
+	}
+}
+
+void loop_unblock_signals()
+{
+	sigprocmask(SIG_UNBLOCK, &loop.sigmask, NULL);
+}
+
+/* FILE DESCRIPTORS *************************************************/
+
+static struct watch *watch_find(int fd)
+{
+	for (list_t *item = loop.watches; item; item = item->next) {
+		struct watch *w = item->data;
+		if (w->fd == fd && ! w->dead)
+			return w;
+	}
+	return NULL;
+}
+
+bool loop_add_fd(int fd, uint32_t events, loop_fd_cb cb, void *arg)
+{
+	struct epoll_event ev;
+	struct watch *w;
+	list_t *item;
+
+	assert(cb != NULL);
+
+	if (! (w = calloc(1, sizeof(struct watch))))
+		return false;
+
+	if (! (item = list_add(&loop.watches))) {
+		destroy(w);
+		return false;
+	}
+	w->fd = fd;
+	w->cb = cb;
+	w->arg = arg;
+	w->dead = false;
+	w->item = item;
+	item->data = w;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = w;
+
+	if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		list_erase(&loop.watches, NULL, item);
+		return false;
+	}
+	return true;
+}
+
+void loop_del_fd(int fd)
+{
+	struct watch *w = watch_find(fd);
+
+	if (w == NULL)
+		return;
+
+	epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, NULL);
+
+	/* events for this watch might still be waiting in this round */
+	if (loop.dispatching)
+		w->dead = true;
+	else
+		list_erase(&loop.watches, NULL, w->item);
+}
+
+/* free watches that were removed during dispatching */
+static void watch_collect()
+{
+	list_t *item = loop.watches;
+
+	while (item) {
+		list_t *next = item->next;
+		if (((struct watch*)item->data)->dead)
+			list_erase(&loop.watches, NULL, item);
+		item = next;
+	}
+}
+
+/* LOOP *************************************************************/
+
+bool loop_init(const int *signals, int len, loop_signal_cb cb, void *arg)
+{
+	loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop.epfd == -1)
+		return false;
+
+	/* block our signals, they are only delivered via signalfd */
+	sigemptyset(&loop.sigmask);
+	for (int i = 0; i < len; i++)
+		sigaddset(&loop.sigmask, signals[i]);
+
+	if (sigprocmask(SIG_BLOCK, &loop.sigmask, NULL) == -1)
+		goto error;
+
+	loop.sigcb = cb;
+	loop.sigarg = arg;
+
+	loop.sigfd = signalfd(-1, &loop.sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (loop.sigfd == -1)
+		goto error;
+
+	loop.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (loop.timerfd == -1)
+		goto error;
+
+	if (! loop_add_fd(loop.sigfd, EPOLLIN, signal_read, NULL)
+			|| ! loop_add_fd(loop.timerfd, EPOLLIN, timer_expired, NULL))
+		goto error;
+
+	return true;
+
+error:
+	loop_free();
+	return false;
+}
+
+void loop_free()
+{
+	list_erase_all(&loop.watches, NULL);
+
+	if (loop.timerfd != -1)
+		close(loop.timerfd);
+	if (loop.sigfd != -1)
+		close(loop.sigfd);
+	if (loop.epfd != -1)
+		close(loop.epfd);
+	loop.timerfd = loop.sigfd = loop.epfd = -1;
+
+	destroy(loop.heap);
+	loop.timers = loop.heap_len = 0;
+	loop.armed = 0;
+}
+
+bool loop_dispatch()
+{
+	struct epoll_event events[LOOP_EVENTS];
+	int n;
+
+	n = epoll_wait(loop.epfd, events, LOOP_EVENTS, -1);
+	if (n == -1)
+		return (errno == EINTR);
+
+	loop.dispatching = true;
+	for (int i = 0; i < n; i++) {
+		struct watch *w = events[i].data.ptr;
+		if (! w->dead)
+			w->cb(w->fd, events[i].events, w->arg);
+	}
+	loop.dispatching = false;
+
+	watch_collect();
+	return true;
+}
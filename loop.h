@@ -0,0 +1,66 @@
+#ifndef __WMWM__LOOP_H__
+#define __WMWM__LOOP_H__
+
+#include <stdbool.h>  // for bool
+#include <stdint.h>   // for uint32_t, uint64_t
+
+/* epoll based event loop
+ *
+ * Watches any number of file descriptors, a signalfd for the signals
+ * handed to loop_init() and one timerfd which is always armed to the
+ * earliest deadline of a min-heap of timers.
+ *
+ * Nothing wakes us up as long as there is nothing to do.
+ *
+ * Times are in microseconds of CLOCK_MONOTONIC.
+ */
+
+/* timer handle, 0 is never a valid timer */
+typedef uint32_t loop_timer_t;
+
+typedef void (*loop_fd_cb)(int fd, uint32_t events, void *arg);
+typedef void (*loop_signal_cb)(int sig, void *arg);
+typedef void (*loop_timer_cb)(void *arg);
+
+/*
+ * Create the loop, block signals[] and deliver them to cb instead.
+ *
+ * Returns false on error, errno is set.
+ */
+bool loop_init(const int *signals, int len, loop_signal_cb cb, void *arg);
+
+/* Close all descriptors of the loop and free all watches and timers. */
+void loop_free();
+
+/* Unblock the signals of loop_init(), meant for a freshly forked child. */
+void loop_unblock_signals();
+
+/* Watch fd for epoll events (EPOLLIN etc.), call cb when there are any. */
+bool loop_add_fd(int fd, uint32_t events, loop_fd_cb cb, void *arg);
+/* Stop watching fd. Safe to call from within any callback. */
+void loop_del_fd(int fd);
+
+/*
+ * Call cb after usec. If interval is non-zero, call cb every interval
+ * after that, keeping the phase of the first deadline.
+ *
+ * Returns a handle for loop_timer_cancel() or 0 on error.
+ */
+loop_timer_t loop_timer_add(uint64_t usec, uint64_t interval,
+		loop_timer_cb cb, void *arg);
+/* Remove timer, ignores timers that are already gone. */
+void loop_timer_cancel(loop_timer_t timer);
+/* Is timer still waiting to be fired? */
+bool loop_timer_pending(loop_timer_t timer);
+
+/* Current monotonic time. */
+uint64_t loop_now();
+
+/*
+ * Wait for events and dispatch all callbacks of one round.
+ *
+ * Returns false on error, errno is set. An interrupted wait is no error.
+ */
+bool loop_dispatch();
+
+#endif /* __WMWM__LOOP_H__ */
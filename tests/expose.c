@@ -0,0 +1,111 @@
+/*
+ * expose - A client counting the Expose events it gets and the area
+ * they cover, for tests/expose.sh.
+ *
+ * usage: expose [name]
+ *
+ * It maps a window and counts until it gets SIGTERM or SIGINT. Then it
+ * prints one line "name exposes pixels resizes" and exits.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>          // for errno, EINTR
+#include <poll.h>           // for poll, pollfd, POLLIN
+#include <signal.h>         // for sigaction, SIGTERM, SIGINT
+#include <stdint.h>         // for uint32_t, uint64_t
+#include <stdio.h>          // for printf, fprintf, stderr
+#include <stdlib.h>         // for free
+#include <string.h>         // for strlen
+
+#include <xcb/xcb.h>        // for xcb_connect, xcb_poll_for_event, ...
+
+static volatile sig_atomic_t done;
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = argc > 1 ? argv[1] : "expose";
+	unsigned exposes = 0;
+	unsigned resizes = 0;
+	uint64_t pixels = 0;
+	uint16_t width = 200;
+	uint16_t height = 200;
+
+	struct sigaction sa = { .sa_handler = stop };
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	xcb_connection_t *conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(conn)) {
+		fprintf(stderr, "%s: can't open display\n", name);
+		return 1;
+	}
+
+	xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+	xcb_window_t win = xcb_generate_id(conn);
+
+	/* a background pixel, like most toolkits, the server clears it */
+	const uint32_t values[2] = {
+		screen->white_pixel,
+		XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_STRUCTURE_NOTIFY
+	};
+	xcb_create_window(conn, XCB_COPY_FROM_PARENT, win, screen->root,
+			0, 0, width, height, 0,
+			XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+			XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win,
+			XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8, strlen(name), name);
+	xcb_map_window(conn, win);
+	xcb_flush(conn);
+
+	struct pollfd pfd = { .fd = xcb_get_file_descriptor(conn), .events = POLLIN };
+
+	while (! done) {
+		xcb_generic_event_t *ev;
+
+		while ((ev = xcb_poll_for_event(conn))) {
+			switch (ev->response_type & ~0x80) {
+			case XCB_EXPOSE: {
+				xcb_expose_event_t *e = (xcb_expose_event_t *)ev;
+				exposes++;
+				pixels += (uint64_t)e->width * e->height;
+				break;
+			}
+			case XCB_CONFIGURE_NOTIFY: {
+				xcb_configure_notify_event_t *e =
+					(xcb_configure_notify_event_t *)ev;
+				if (e->window == win && (e->width != width
+							|| e->height != height)) {
+					width = e->width;
+					height = e->height;
+					resizes++;
+				}
+				break;
+			}
+			}
+			free(ev);
+		}
+
+		if (xcb_connection_has_error(conn)) {
+			fprintf(stderr, "%s: connection lost\n", name);
+			return 1;
+		}
+
+		/* wake up now and then, a signal may come before poll() */
+		if (poll(&pfd, 1, 100) < 0 && errno != EINTR) {
+			perror("poll");
+			return 1;
+		}
+	}
+
+	printf("%s %u %llu %u\n", name, exposes, (unsigned long long)pixels,
+			resizes);
+	xcb_disconnect(conn);
+	return 0;
+}
@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# Count the Expose events tiled clients get while their tiles are
+# resized over and over, and the area those events cover. Each round
+# maps one more window on the workspace, which shrinks all tiles, and
+# closes it again, which grows them back.
+#
+# usage: tests/expose.sh [wmwm ...]
+#
+# Runs the same rounds under each wmwm given, on an Xvfb of its own, and
+# prints one line per wmwm, to compare two builds. It only fails if
+# a wmwm dies or doesn't manage the clients.
+#
+# Needs tests/expose (make tests/expose), xprop and xlogo (or
+# WINDOW_CMD). Exits with 77 if one of them is missing.
+
+CLIENTS=${CLIENTS:-4}
+ROUNDS=${ROUNDS:-50}
+
+XSERVER=${XSERVER:-Xvfb}
+EXPOSE=${EXPOSE:-tests/expose}
+WINDOW_CMD=${WINDOW_CMD:-xlogo}
+
+[ $# -gt 0 ] || set -- ./wmwm
+
+for tool in $XSERVER xprop $EXPOSE $WINDOW_CMD; do
+	if ! command -v $tool >/dev/null; then
+		echo "skipped: $tool is missing" >&2
+		exit 77
+	fi
+done
+
+pids=
+out=$(mktemp -d) || exit 1
+cleanup()
+{
+	kill $pids 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$out"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+fail()
+{
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# wait up to $1 tenths of a second for the command after it
+wait_for()
+{
+	tries=$1
+	shift
+	until "$@" >/dev/null 2>&1; do
+		tries=$((tries - 1))
+		[ $tries -gt 0 ] || return 1
+		sleep 0.1
+	done
+}
+
+clients()
+{
+	xprop -root _NET_CLIENT_LIST | tr ',' '\n' | grep -c 0x
+}
+
+has_clients()
+{
+	[ "$(clients)" -eq "$1" ]
+}
+
+DISPLAY=:${DISPLAYNUM:-98}
+export DISPLAY
+
+for wm in "$@"; do
+	$XSERVER $DISPLAY -screen 0 1280x1024x24 -nolisten tcp &
+	xpid=$!
+	wait_for 100 xprop -root || fail "no X server on $DISPLAY"
+
+	"$wm" &
+	wmpid=$!
+	pids="$xpid $wmpid"
+	wait_for 100 xprop -root _NET_SUPPORTING_WM_CHECK || fail "$wm didn't start"
+
+	i=0
+	counters=
+	while [ $i -lt $CLIENTS ]; do
+		$EXPOSE expose$i > "$out/$i" &
+		counters="$counters $!"
+		i=$((i + 1))
+	done
+	pids="$pids $counters"
+	wait_for 100 has_clients $CLIENTS || fail "$wm: only $(clients) of $CLIENTS clients managed"
+
+	r=0
+	while [ $r -lt $ROUNDS ]; do
+		$WINDOW_CMD &
+		extra=$!
+		wait_for 100 has_clients $((CLIENTS + 1)) || fail "$wm: round $r, no new tile"
+		kill $extra
+		wait $extra 2>/dev/null
+		wait_for 100 has_clients $CLIENTS || fail "$wm: round $r, tile not closed"
+		r=$((r + 1))
+	done
+	sleep 1
+	kill -0 $wmpid 2>/dev/null || fail "$wm is gone"
+
+	kill -TERM $counters
+	wait $counters 2>/dev/null
+	cat "$out"/* | awk -v wm="$wm" -v rounds=$ROUNDS '
+		{ exposes += $2; pixels += $3; resizes += $4 }
+		END {
+			printf "%s: %d exposes, %d pixels in %d resizes, %d rounds\n",
+				wm, exposes, pixels, resizes, rounds
+		}'
+
+	kill $wmpid $xpid 2>/dev/null
+	wait $wmpid $xpid 2>/dev/null
+	pids=
+done
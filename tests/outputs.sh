@@ -0,0 +1,180 @@
+#!/bin/sh
+#
+# Change the outputs under a running wmwm while it manages hundreds of
+# windows. After each change wmwm has to be alive, still manage all of
+# them, and every window that is shown has to be on an output.
+#
+# usage: tests/outputs.sh [wmwm] [windows] [rounds]
+#
+# It starts an Xvfb of its own. Xvfb has a single output, "screen",
+# which is shrunk, turned off, turned on and grown again each round.
+# Xvfb can't have more than one output, so unplugging one of several
+# while the others stay on isn't covered by default. To test that, run
+# it on a server with several outputs, with XSERVER=none, DISPLAY set
+# to it and OUTPUT to the one to turn off.
+#
+# Xvfb only has a mode for the size it started with, the SMALL and
+# LARGE modes are added to OUTPUT from cvt if it lacks them.
+#
+# Needs xrandr, cvt, xprop, xwininfo, wmctrl and xlogo (or WINDOW_CMD).
+# Exits with 77 if one of them is missing.
+
+WMWM=${1:-./wmwm}
+WINDOWS=${2:-300}
+ROUNDS=${3:-5}
+
+XSERVER=${XSERVER:-Xvfb}
+OUTPUT=${OUTPUT:-screen}
+LARGE=${LARGE:-1280x1024}
+SMALL=${SMALL:-800x600}
+DESKTOPS=${DESKTOPS:-10}
+WINDOW_CMD=${WINDOW_CMD:-xlogo}
+SETTLE=${SETTLE:-1}
+
+for tool in xrandr cvt xprop xwininfo wmctrl $WINDOW_CMD; do
+	if ! command -v $tool >/dev/null; then
+		echo "skipped: $tool is missing" >&2
+		exit 77
+	fi
+done
+
+pids=
+cleanup()
+{
+	kill $pids 2>/dev/null
+	wait 2>/dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+fail()
+{
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# wait up to $1 tenths of a second for the command after it
+wait_for()
+{
+	tries=$1
+	shift
+	until "$@" >/dev/null 2>&1; do
+		tries=$((tries - 1))
+		[ $tries -gt 0 ] || return 1
+		sleep 0.1
+	done
+}
+
+clients()
+{
+	xprop -root _NET_CLIENT_LIST | tr ',' '\n' | grep -c 0x
+}
+
+has_clients()
+{
+	[ "$(clients)" -ge "$1" ]
+}
+
+# area of OUTPUT as "w h x y", nothing while it's off
+output_area()
+{
+	xrandr --current | sed -n \
+		"s/^$OUTPUT connected[^0-9]*\([0-9]*\)x\([0-9]*\)+\([0-9]*\)+\([0-9]*\).*/\1 \2 \3 \4/p"
+}
+
+# add mode $1, WxH, to OUTPUT unless it has it
+add_mode()
+{
+	xrandr --current | sed -n "/^$OUTPUT /,/^[^ ]/p" | grep -q "^ *$1 " && return 0
+
+	set -- "$1" $(cvt ${1%x*} ${1#*x} | sed -n 's/^Modeline "[^"]*" *//p')
+	name=$1
+	shift
+	[ $# -gt 0 ] || return 1
+	# it may be known, just not on OUTPUT
+	xrandr --newmode "$name" "$@" 2>/dev/null
+	xrandr --addmode "$OUTPUT" "$name"
+}
+
+# print the viewable children of root that are off area
+off_area()
+{
+	xwininfo -root -children | sed -n \
+		's/^ *\(0x[0-9a-f]*\) .*  \([0-9]*\)x\([0-9]*\)+\(-*[0-9]*\)+\(-*[0-9]*\)  .*/\1 \2 \3 \4 \5/p' |
+	while read id ww wh wx wy; do
+		xwininfo -id $id | grep -q IsViewable || continue
+		if [ $wx -ge $((ax + aw)) ] || [ $wy -ge $((ay + ah)) ] \
+				|| [ $((wx + ww)) -le $ax ] || [ $((wy + wh)) -le $ay ]; then
+			echo "$id at ${ww}x${wh}+${wx}+${wy}"
+		fi
+	done
+}
+
+check()
+{
+	sleep $SETTLE
+	kill -0 $wmpid 2>/dev/null || fail "$1: wmwm is gone"
+
+	n=$(clients)
+	[ "$n" -eq "$WINDOWS" ] || fail "$1: $n of $WINDOWS windows managed"
+
+	area=$(output_area)
+	[ -n "$area" ] || return 0
+	set -- "$1" $area
+	aw=$2 ah=$3 ax=$4 ay=$5
+
+	off=$(off_area)
+	[ -z "$off" ] || fail "$1: windows off ${aw}x${ah}+${ax}+${ay}:
+$off"
+	echo "ok: $1"
+}
+
+if [ "$XSERVER" != none ]; then
+	DISPLAY=:${DISPLAYNUM:-99}
+	export DISPLAY
+	$XSERVER $DISPLAY -screen 0 ${LARGE}x24 +extension RANDR -nolisten tcp &
+	pids="$pids $!"
+	wait_for 100 xprop -root || fail "no X server on $DISPLAY"
+fi
+
+"$WMWM" &
+wmpid=$!
+pids="$pids $wmpid"
+wait_for 100 xprop -root _NET_SUPPORTING_WM_CHECK || fail "wmwm didn't start"
+
+add_mode "$SMALL" || fail "can't add mode $SMALL to $OUTPUT"
+add_mode "$LARGE" || fail "can't add mode $LARGE to $OUTPUT"
+
+# spread over the screen, some will be off the small one
+i=0
+while [ $i -lt $WINDOWS ]; do
+	$WINDOW_CMD -geometry 100x100+$((i * 37 % 1200))+$((i * 53 % 1000)) &
+	pids="$pids $!"
+	i=$((i + 1))
+done
+wait_for 600 has_clients $WINDOWS || fail "only $(clients) of $WINDOWS windows mapped"
+
+# and over the workspaces, so tiles keep a useful size
+i=0
+for id in $(xprop -root _NET_CLIENT_LIST | tr ',' ' ' | grep -o '0x[0-9a-f]*'); do
+	wmctrl -i -r $id -t $((i % DESKTOPS))
+	i=$((i + 1))
+done
+check "start"
+
+r=1
+while [ $r -le $ROUNDS ]; do
+	# hidden workspaces are laid out when they are shown
+	wmctrl -s $((r % DESKTOPS))
+
+	xrandr --output "$OUTPUT" --mode "$SMALL" || fail "no mode $SMALL"
+	check "round $r, $OUTPUT shrunk to $SMALL"
+
+	xrandr --output "$OUTPUT" --off
+	check "round $r, $OUTPUT off"
+
+	xrandr --output "$OUTPUT" --mode "$LARGE" || fail "no mode $LARGE"
+	check "round $r, $OUTPUT back at $LARGE"
+
+	r=$((r + 1))
+done
@@ -0,0 +1,201 @@
+/*
+ * solver - Unit test for solve_tiles(), how a tiler's length is split
+ * among its tiles within their size limits.
+ *
+ * It builds wmwm.c in, with its main() renamed, to reach the static
+ * solver, and runs it on tilers of client tiles without any X server.
+ * Borders and gaps are 0, a tile's span is its window's size.
+ */
+
+#define main wmwm_main
+#include "../wmwm.c"
+#undef main
+
+#define TILES_MAX 8
+
+static int failed;
+
+#define EXPECT(cond) \
+	do { \
+		if (! (cond)) { \
+			fprintf(stderr, "%s:%d: %s: expected %s\n", \
+					__FILE__, __LINE__, test, #cond); \
+			failed = 1; \
+		} \
+	} while (0)
+
+/*
+ * Solve length along AXIS_X among n tiles with limits lim and favor
+ * (1 each if NULL), their spans end up in span.
+ */
+static void solve(int length, int n, const limits_t *lim, const float *favor,
+		uint32_t *span)
+{
+	client_t clients[TILES_MAX];
+	wtree_t *tiles[TILES_MAX];
+	const xcb_rectangle_t geo = { 0, 0, length, length };
+	wtree_t *ws = wtree_new_workspace(geo);
+	wtree_t *tiler = wtree_new_tiling(TILING_VERTICAL);
+
+	wtree_append_child(ws, tiler);
+	memset(clients, 0, sizeof(clients));
+	for (int i = 0; i < n; i++) {
+		tiles[i] = wtree_new_client(&clients[i], false);
+		wtree_set_limits(tiles[i], AXIS_X, lim[i]);
+		if (favor)
+			wtree_set_favor(tiles[i], favor[i]);
+		wtree_append_child(tiler, tiles[i]);
+	}
+
+	solve_tiles(tiler, AXIS_X, length);
+
+	for (int i = 0; i < n; i++) {
+		span[i] = wtree_span(tiles[i]);
+		wtree_free(tiles[i]);
+	}
+	wtree_free(tiler);
+	wtree_free(ws);
+}
+
+static uint32_t sum(int n, const uint32_t *span)
+{
+	uint32_t total = 0;
+	for (int i = 0; i < n; i++)
+		total += span[i];
+	return total;
+}
+
+/* on one of its increments from base */
+static bool on_inc(limits_t lim, uint32_t span)
+{
+	return span >= lim.base && (span - lim.base) % lim.inc == 0;
+}
+
+/* One tile at most 400, the other at least 900, of 1000. */
+static void test_max_and_min()
+{
+	const char *test = "max and min";
+	const limits_t lim[2] = { { 0, 400, 0, 1 }, { 900, 0, 0, 1 } };
+	uint32_t span[2];
+
+	solve(1000, 2, lim, NULL, span);
+	EXPECT(span[0] == 100);
+	EXPECT(span[1] == 900);
+}
+
+/* Without limits the shares are even, the last gets the rounding. */
+static void test_even()
+{
+	const char *test = "even";
+	const limits_t lim[3] = { { 0, 0, 0, 1 }, { 0, 0, 0, 1 }, { 0, 0, 0, 1 } };
+	uint32_t span[3];
+
+	solve(1000, 3, lim, NULL, span);
+	EXPECT(sum(3, span) == 1000);
+	for (int i = 0; i < 3; i++)
+		EXPECT(span[i] == 333 || span[i] == 334);
+}
+
+/* Increments are kept, a tile that takes any size gets the rest. */
+static void test_increments()
+{
+	const char *test = "increments";
+	const limits_t lim[3] = { { 20, 0, 4, 7 }, { 0, 0, 0, 1 }, { 20, 0, 4, 9 } };
+	uint32_t span[3];
+
+	solve(1000, 3, lim, NULL, span);
+	EXPECT(sum(3, span) == 1000);
+	EXPECT(on_inc(lim[0], span[0]));
+	EXPECT(on_inc(lim[2], span[2]));
+	EXPECT(span[0] >= 320 && span[0] <= 340);
+	EXPECT(span[2] >= 320 && span[2] <= 340);
+}
+
+/* Cutting down to its increment would go below its min, so round up. */
+static void test_increments_up()
+{
+	const char *test = "increments up";
+	const limits_t lim[2] = { { 105, 0, 4, 10 }, { 0, 0, 0, 1 } };
+	uint32_t span[2];
+
+	solve(210, 2, lim, NULL, span);
+	EXPECT(span[0] == 114);
+	EXPECT(span[1] == 96);
+}
+
+/* Only tiles with increments, the last one takes what's left. */
+static void test_increments_only()
+{
+	const char *test = "increments only";
+	const limits_t lim[2] = { { 95, 0, 5, 10 }, { 95, 0, 5, 10 } };
+	uint32_t span[2];
+
+	solve(203, 2, lim, NULL, span);
+	EXPECT(sum(2, span) == 203);
+	EXPECT(on_inc(lim[0], span[0]));
+	EXPECT(span[0] >= 95 && span[1] >= 95);
+}
+
+/* The mins don't fit, the tiles get their favor and nothing more. */
+static void test_no_fit()
+{
+	const char *test = "no fit";
+	const limits_t lim[2] = { { 600, 0, 0, 1 }, { 600, 0, 0, 1 } };
+	const float favor[2] = { 3, 1 };
+	uint32_t span[2];
+
+	solve(1000, 2, lim, NULL, span);
+	EXPECT(span[0] == 500);
+	EXPECT(span[1] == 500);
+
+	solve(1000, 2, lim, favor, span);
+	EXPECT(span[0] == 750);
+	EXPECT(span[1] == 250);
+}
+
+/* All tiles at their max, the last one still fills the tiler. */
+static void test_all_max()
+{
+	const char *test = "all max";
+	const limits_t lim[2] = { { 0, 100, 0, 1 }, { 0, 100, 0, 1 } };
+	uint32_t span[2];
+
+	solve(1000, 2, lim, NULL, span);
+	EXPECT(span[0] == 100);
+	EXPECT(span[1] == 900);
+}
+
+/* Shares go by favor, unless a limit is in the way. */
+static void test_favor()
+{
+	const char *test = "favor";
+	const limits_t any[2] = { { 0, 0, 0, 1 }, { 0, 0, 0, 1 } };
+	const limits_t lim[2] = { { 0, 0, 0, 1 }, { 500, 0, 0, 1 } };
+	const float favor[2] = { 3, 1 };
+	uint32_t span[2];
+
+	solve(1000, 2, any, favor, span);
+	EXPECT(span[0] == 750);
+	EXPECT(span[1] == 250);
+
+	solve(1000, 2, lim, favor, span);
+	EXPECT(span[0] == 500);
+	EXPECT(span[1] == 500);
+}
+
+int main(void)
+{
+	test_max_and_min();
+	test_even();
+	test_increments();
+	test_increments_up();
+	test_increments_only();
+	test_no_fit();
+	test_all_max();
+	test_favor();
+
+	if (failed)
+		return 1;
+	printf("ok: solver\n");
+	return 0;
+}
@@ -19,6 +19,8 @@
 static container_t* container_new()
 {
 	container_t *tmp = calloc(1, sizeof(container_t));
+	if (tmp == NULL) return NULL;
+	tmp->favor = 1.0f;
 	return tmp;
 }
 
@@ -38,6 +40,7 @@ static container_t* container_new_client(client_t *client, bool floating)
 	tmp->type = CONTAINER_CLIENT;
 	tmp->client = client;
 	tmp->floating = floating;
+	tmp->limits[AXIS_X].inc = tmp->limits[AXIS_Y].inc = 1;
 	return tmp;
 }
 
@@ -49,6 +52,7 @@ static container_t* container_new_tiling(tiling_t tile)
 	tmp->tile = tile;
 //	tmp->tgeo = geo;
 	tmp->tiles = 0;
+	tmp->active = NULL;
 	return tmp;
 }
 
@@ -147,6 +151,19 @@ void wtree_set_screen_geo(wtree_t *node, xcb_rectangle_t geo)
 	wtree_data(node)->sgeo = geo;
 }
 
+uint32_t wtree_dirty(wtree_t *node)
+{
+	return wtree_data(node)->dirty;
+}
+void wtree_mark_dirty(wtree_t *node)
+{
+	++(wtree_data(node)->dirty);
+}
+void wtree_mark_clean(wtree_t *node)
+{
+	wtree_data(node)->dirty = 0;
+}
+
 /* TILING NODE FUNCTIONS *******************************************/
 
 /* change count of clients in node */
@@ -171,6 +188,73 @@ static void wtree_minus(wtree_t *node)
 	}
 }
 
+// weight of a tile in its tiling-node
+float wtree_favor(wtree_t *node)
+{
+	return wtree_data(node)->favor;
+}
+
+void wtree_set_favor(wtree_t *node, float favor)
+{
+	assert(favor > 0);
+	wtree_data(node)->favor = favor;
+}
+
+// add up the weights of the tiles in tiler, floating ones don't count
+float wtree_favor_sum(wtree_t *tiler)
+{
+	float sum = 0;
+
+	for (wtree_t *node = tiler->child; node; node = node->next) {
+		if (wtree_is_tile(node))
+			sum += wtree_data(node)->favor;
+	}
+	return sum;
+}
+
+uint32_t wtree_span(wtree_t *node)
+{
+	return wtree_data(node)->span;
+}
+
+void wtree_set_span(wtree_t *node, uint32_t span)
+{
+	wtree_data(node)->span = span;
+}
+
+limits_t wtree_need(wtree_t *node)
+{
+	return wtree_data(node)->need;
+}
+
+void wtree_set_need(wtree_t *node, limits_t need)
+{
+	wtree_data(node)->need = need;
+}
+
+limits_t wtree_limits(wtree_t *node, int axis)
+{
+	assert(wtree_is_client_type(node));
+	return wtree_data(node)->limits[axis];
+}
+
+void wtree_set_limits(wtree_t *node, int axis, limits_t limits)
+{
+	assert(wtree_is_client_type(node));
+	assert(limits.inc > 0);
+	wtree_data(node)->limits[axis] = limits;
+}
+
+xcb_rectangle_t wtree_tgeo(wtree_t *tiler)
+{
+	return wtree_data(tiler)->tgeo;
+}
+
+void wtree_set_tgeo(wtree_t *tiler, xcb_rectangle_t geo)
+{
+	wtree_data(tiler)->tgeo = geo;
+}
+
 // return number of children
 uint16_t wtree_tiles(wtree_t *node)
 {
@@ -191,6 +275,60 @@ void wtree_set_tiling(wtree_t *node, tiling_t tiling)
 	wtree_data(node)->tile = tiling;
 }
 
+/* does node take part in tiling */
+bool wtree_is_tile(wtree_t *node)
+{
+	if (wtree_is_client_type(node))
+		return ! wtree_data(node)->floating;
+	return (wtree_is_tiling_type(node) && wtree_data(node)->tiles > 0);
+}
+
+// return active tile or the first one if that's gone
+wtree_t *wtree_active(wtree_t *tiler)
+{
+	assert(tiler != NULL);
+	assert(wtree_is_tiling_type(tiler));
+
+	wtree_t *active = wtree_data(tiler)->active;
+
+	// it might have been swapped away or started floating
+	if (active && active->parent == tiler && wtree_is_tile(active))
+		return active;
+
+	for (active = tiler->child; active; active = active->next) {
+		if (wtree_is_tile(active))
+			break;
+	}
+	wtree_data(tiler)->active = active;
+	return active;
+}
+
+// activate node in each tiling-node on the way up
+void wtree_set_active(wtree_t *node)
+{
+	assert(node != NULL);
+
+	for (; node->parent && wtree_is_tiling_type(node->parent);
+			node = node->parent)
+		wtree_data(node->parent)->active = node;
+}
+
+// next tile among the siblings of node, or the previous if it's the last
+wtree_t *wtree_neighbor_tile(wtree_t *node)
+{
+	wtree_t *sib;
+
+	for (sib = node->next; sib; sib = sib->next) {
+		if (wtree_is_tile(sib))
+			return sib;
+	}
+	for (sib = node->prev; sib; sib = sib->prev) {
+		if (wtree_is_tile(sib))
+			return sib;
+	}
+	return NULL;
+}
+
 /* CLIENT NODE FUNCTIONS *******************************************/
 
 // return client of node
@@ -239,11 +377,21 @@ void wtree_set_parent_tiling(wtree_t *node, tiling_t tiling)
 /*************************************************************/
 // node action functions
 
-// add _node_ after _current_ node
+// swap nodes, but leave the weights where they were
+void wtree_swap(wtree_t *from, wtree_t *to)
+{
+	const float favor = wtree_data(from)->favor;
+
+	tree_swap(from, to);
+	wtree_data(from)->favor = wtree_data(to)->favor;
+	wtree_data(to)->favor = favor;
+}
+
+// add _node_ after _current_ node, a whole container with its tiles
 void wtree_add_sibling(wtree_t *current, wtree_t *node)
 {
 	tree_add(current, node);
-	if (wtree_is_client_type(node) && ! wtree_data(node)->floating)
+	if (wtree_is_tile(node))
 		wtree_plus(node->parent);
 }
 
@@ -254,7 +402,8 @@ void wtree_append_child(wtree_t *parent, wtree_t *node)
 	// other vars
 	if (parent->child == NULL) {
 		parent->child = node;
-		if (wtree_is_client_type(node) && ! wtree_data(node)->floating)
+		// the workspace doesn't count its tiles
+		if (wtree_is_tile(node) && wtree_is_tiling_type(parent))
 			wtree_plus(parent);
 	} else {
 		wtree_t *sib = parent->child;
@@ -277,6 +426,12 @@ void wtree_inter_tile(wtree_t *client, tiling_t mode)
 	} else {
 		tree_replace(client, tiler);
 	}
+	// tiler takes over the place of client as active tile
+	if (wtree_data(tiler->parent)->active == client)
+		wtree_data(tiler->parent)->active = tiler;
+	// and its size, client gets all of tiler for now
+	wtree_data(tiler)->favor = wtree_data(client)->favor;
+	wtree_data(client)->favor = 1.0f;
 	// add client to tiler
 	wtree_append_child(tiler, client);
 }
@@ -307,7 +462,7 @@ void wtree_append_tile_child(wtree_t *parent, wtree_t *node,
 	PDEBUG("--3--\n");
 }
 
-/* unlink node from tree, no children handling */
+/* unlink node from tree, a container keeps its children */
 void wtree_remove(wtree_t *node)
 {
 	assert(node != NULL);
@@ -318,8 +473,11 @@ void wtree_remove(wtree_t *node)
 
 	// update parent node
 	if (parent && wtree_is_tiling_type(parent)) {
-		// decrement child counter
-		if (wtree_is_client_type(node) && ! wtree_data(node)->floating)
+		// don't keep a pointer to what might get freed
+		if (wtree_data(parent)->active == node)
+			wtree_data(parent)->active = NULL;
+		// decrement child counter, also for a container with tiles
+		if (wtree_is_tile(node))
 			wtree_minus(parent);
 		// in case of non-root-parent tile, remove it
 		if (tree_child(parent) == NULL) {
@@ -355,6 +513,32 @@ void wtree_traverse_clients(wtree_t *node, void(*action)(client_t *))
 		wtree_traverse_clients(node->child, action);
 }
 
+// wtree_traverse_clients with an argument for _action_
+void wtree_foreach_client(wtree_t *node, void(*action)(client_t *, void *),
+		void *arg)
+{
+	if (node == NULL)
+		return;
+
+	if (wtree_is_client_type(node))
+		action(wtree_client(node), arg);
+
+	wtree_foreach_client(node->next, action, arg);
+	wtree_foreach_client(node->child, action, arg);
+}
+
+// apply _action_ on node and each client beneath it, siblings are left out
+void wtree_traverse_subtree(wtree_t *node, void(*action)(client_t *))
+{
+	if (node == NULL)
+		return;
+
+	if (wtree_is_client_type(node))
+		action(wtree_client(node));
+	else
+		wtree_traverse_clients(node->child, action);
+}
+
 // recursive function to search for a client_t that fulfils _compare_
 /* pre-order */
 client_t *wtree_find_client(wtree_t *node, bool(*compare)(client_t*, void *), void *arg)
@@ -392,6 +576,9 @@ static void wtree_print_tree_r(FILE *file, wtree_t *cur, int *i)
 			case TILING_HORIZONTAL:
 				snprintf(num, 10, "H%d", *i);
 				break;
+			case TILING_TABBED:
+				snprintf(num, 10, "T%d", *i);
+				break;
 			default:
 				snprintf(num, 10, "X%d", *i);
 				break;
@@ -23,7 +23,8 @@ typedef tree_t wtree_t;
 /* Tiling modes */
 typedef enum tiling_modes {
 	TILING_HORIZONTAL,
-	TILING_VERTICAL
+	TILING_VERTICAL,
+	TILING_TABBED	/* only the active tile is shown, using all the space */
 } tiling_t;
 
 /* general container types */
@@ -33,27 +34,47 @@ typedef enum container_types {
 	CONTAINER_CLIENT
 } container_type;
 
+/* axes of a tile, to index limits_t */
+#define AXIS_X 0
+#define AXIS_Y 1
+
+/*
+ * Sizes a window takes along one axis, from its WM_NORMAL_HINTS.
+ * It takes base + n * inc, no less than min and no more than max.
+ */
+typedef struct limits {
+	uint32_t min;
+	uint32_t max;	/* 0 for none */
+	uint32_t base;
+	uint32_t inc;	/* 1 for any size */
+} limits_t;
+
 /* container * static local helper functions in window_tree.c */
 // XXX order?
-typedef struct container { // (24b on x86_64)
+typedef struct container { // (80b on x86_64)
 	container_type type; // (4b on x86_64)
+	float favor; // size of a tile in relation to its siblings, 1.0 by default
+	uint32_t span; // length it got along the split of its parent
+	limits_t need; // limits of the whole tile along that split, ditto
 	union {
-		// CONTAINER_WORKSPACE (16b on x86_64)
+		// CONTAINER_WORKSPACE (20->24b on x86_64)
 		struct {
 			client_t *focuswin;
-			xcb_rectangle_t sgeo;
+			xcb_rectangle_t sgeo; // space to lay out in
+			uint32_t dirty; // changes since the last layout
 		};
-		// CONTAINER_TILING (14->16b on x86_64)
+		// CONTAINER_TILING (22->24b on x86_64)
 		struct {
 			xcb_rectangle_t tgeo;
 			tiling_t tile;
 			uint16_t tiles;
+			tree_t *active; // shown tile of TILING_TABBED
 		};
-		// CONTAINER_CLIENT (13->16b on x86_64)
+		// CONTAINER_CLIENT (41->48b on x86_64)
 		struct {
 			client_t *client;
-			float favor; // XXX, window size in relation to others
 			bool floating;
+			limits_t limits[2]; // of the window by axis
 		};
 	};
 } container_t;
@@ -66,6 +87,15 @@ wtree_t* wtree_new_workspace(xcb_rectangle_t geo);
 client_t *wtree_focuswin(wtree_t *node);
 void wtree_set_focuswin(wtree_t *node, client_t *client);
 
+/* get/set the space the workspace is laid out in */
+xcb_rectangle_t wtree_screen_geo(wtree_t *node);
+void wtree_set_screen_geo(wtree_t *node, xcb_rectangle_t geo);
+
+/* count changes to a workspace until it's laid out, see container_t */
+uint32_t wtree_dirty(wtree_t *node);
+void wtree_mark_dirty(wtree_t *node);
+void wtree_mark_clean(wtree_t *node);
+
 /* free node and its data */
 void wtree_free(wtree_t *node);
 
@@ -76,6 +106,8 @@ client_t *wtree_client(wtree_t *node);
 bool wtree_is_client_type(wtree_t *node);
 bool wtree_is_tiling_type(wtree_t *node);
 bool wtree_is_workspace_type(wtree_t *node);
+/* non-floating client-node or tiling-node with tiles */
+bool wtree_is_tile(wtree_t *node);
 
 wtree_t *wtree_next(wtree_t *node);
 
@@ -86,6 +118,26 @@ bool wtree_is_floating(wtree_t *node);
 /* get number of tiles/children */
 uint16_t wtree_tiles(wtree_t *node);
 
+/* get/set the weight of a tile, see container_t */
+float wtree_favor(wtree_t *node);
+void wtree_set_favor(wtree_t *node, float favor);
+/* sum of the weights of all tiles below tiler */
+float wtree_favor_sum(wtree_t *tiler);
+
+/* get/set the length and limits of a tile within its parent, see container_t */
+uint32_t wtree_span(wtree_t *node);
+void wtree_set_span(wtree_t *node, uint32_t span);
+limits_t wtree_need(wtree_t *node);
+void wtree_set_need(wtree_t *node, limits_t need);
+
+/* get/set the size limits of a client-node's window along axis */
+limits_t wtree_limits(wtree_t *node, int axis);
+void wtree_set_limits(wtree_t *node, int axis, limits_t limits);
+
+/* get/set the space tiler got at its last layout */
+xcb_rectangle_t wtree_tgeo(wtree_t *tiler);
+void wtree_set_tgeo(wtree_t *tiler, xcb_rectangle_t geo);
+
 /* get tiling_t of node/parent */
 tiling_t wtree_tiling(wtree_t *node);
 tiling_t wtree_parent_tiling(wtree_t *node);
@@ -94,14 +146,22 @@ tiling_t wtree_parent_tiling(wtree_t *node);
 void wtree_set_tiling(wtree_t *node, tiling_t tiling);
 void wtree_set_parent_tiling(wtree_t *node, tiling_t tiling);
 
-/* swap from with to */
-static void wtree_swap(wtree_t *from, wtree_t *to) { tree_swap(from, to); }
+/* swap from with to, their places keep their weights */
+void wtree_swap(wtree_t *from, wtree_t *to);
 
 /* add/append sibling/children */
 void wtree_add_sibling(wtree_t *current, wtree_t *node);
 void wtree_append_sibling(wtree_t *current, wtree_t *node);
 void wtree_append_child(wtree_t *parent, wtree_t *node);
 
+/* get the active tile of tiler, falls back to its first tile */
+wtree_t *wtree_active(wtree_t *tiler);
+/* make node the active tile of its parent and all its parents */
+void wtree_set_active(wtree_t *node);
+
+/* next tile sibling of node or the previous one if there's none */
+wtree_t *wtree_neighbor_tile(wtree_t *node);
+
 /* put new tiling node between client and client->parent */
 void wtree_inter_tile(wtree_t *client, tiling_t mode);
 
@@ -109,11 +169,16 @@ void wtree_inter_tile(wtree_t *client, tiling_t mode);
 void wtree_add_tile_sibling(wtree_t *current, wtree_t *node, tiling_t tiling);
 void wtree_append_tile_child(wtree_t *current, wtree_t *node, tiling_t tiling);
 
-/* unlink node from tree, fix siblings and parent */
+/* unlink node from tree, fix siblings and parent, children stay with it */
 void wtree_remove(wtree_t *node);
 
 /* for each client-node below node, do action(client), pre-order*/
 void wtree_traverse_clients(wtree_t *node, void(*action)(client_t *));
+/* do action(client) for node and each client-node below, not its siblings */
+void wtree_traverse_subtree(wtree_t *node, void(*action)(client_t *));
+/* same as wtree_traverse_clients, passing arg along */
+void wtree_foreach_client(wtree_t *node, void(*action)(client_t *, void *),
+		void *arg);
 /* find node below _node_ that has compare(client) == true, pre-order */
 client_t *wtree_find_client(wtree_t *node, bool(*compare)(client_t*, void *), void *arg);
 
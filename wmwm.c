@@ -30,20 +30,23 @@
 #include <assert.h>
 #include <errno.h>            // for EINTR, errno
 #include <getopt.h>           // for optarg, getopt
-#include <poll.h>             // for pollfd, poll, POLLIN
-#include <signal.h>           // for signal, SIG_DFL, SIG_ERR, SIGCHLD, SIGINT
+#include <inttypes.h>         // for PRIu64
+#include <signal.h>           // for SIGCHLD, SIGINT, SIGTERM
 #include <stdbool.h>          // for false, bool, true
 #include <stdint.h>           // for uint32_t, uint16_t, uint8_t, int16_t
 #include <stdio.h>            // for NULL, fprintf, stderr, perror, printf
 #include <stdlib.h>           // for free, exit, calloc, atoi, strtoul
 #include <string.h>           // for strlen, memset, strcpy, strncpy
 #include <unistd.h>           // for execvp, fork, setsid, pid_t
+#include <sys/epoll.h>        // for EPOLLIN
+#include <sys/wait.h>         // for waitpid, WNOHANG
 
 #include <X11/keysymdef.h>    // for XK_VoidSymbol
 
 #include <xcb/xcb.h>          // for xcb_generic_event_t, xcb_generic_error_t
 #include <xcb/randr.h>        // for xcb_randr_get_crtc_info_reply_t, xcb_ra...
 #include <xcb/shape.h>        // for xcb_shape_notify_event_t, xcb_shape_com...
+#include <xcb/sync.h>         // for xcb_sync_alarm_notify_event_t, xcb_sync...
 #include <xcb/xcb_event.h>    // for xcb_event_get_error_label, xcb_event_ge...
 #include <xcb/xcb_ewmh.h>     // for xcb_ewmh_connection_t, xcb_ewmh_set_act...
 #include <xcb/xcb_icccm.h>    // for xcb_size_hints_t, ::XCB_ICCCM_SIZE_HINT...
@@ -57,6 +60,9 @@
 /* container functions */
 #include "window_tree.h"
 
+/* event loop */
+#include "loop.h"             // for loop_init, loop_add_fd, loop_dispatch
+
 
 /* Check here for user configurable parts: */
 #include "config.h"
@@ -75,6 +81,9 @@
 #endif
 
 #define destroy(x) do { free(x); x = NULL; } while (0)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 
 /* Internal Constants. */
@@ -109,6 +118,9 @@ typedef enum {
 } size_hint_t;
 */
 
+/* Maximum number of events scheduled at once. */
+#define EVENT_BATCH 128
+
 /* This means we didn't get any window hint at all. */
 #define WORKSPACE_NONE  0xfffffffe
 
@@ -135,6 +147,13 @@ typedef enum {
  */
 #define HIDDEN_FRAME_EVENTS (XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY)
 
+/* Events of a window that is its own frame
+ *
+ * Like those of a frame, substructure events come in via the root
+ * window, when hidden it's only the DEFAULT_WINDOW_EVENTS.
+ */
+#define DIRECT_WINDOW_EVENTS (DEFAULT_WINDOW_EVENTS | XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_FOCUS_CHANGE)
+
 /* What we listen to on the root window */
 #define DEFAULT_ROOT_WINDOW_EVENTS (XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_ENTER_WINDOW)
 
@@ -144,6 +163,9 @@ typedef enum {
 
 int sigcode;					/* Signal code. Non-zero if we've been
 								 * interrupted by a signal. */
+const int signals[] = {			/* Signals we receive via the event loop */
+	SIGINT, SIGTERM, SIGCHLD, SIGUSR1
+};
 xcb_connection_t *conn;			/* Connection to X server. */
 xcb_screen_t *screen;			/* Our current screen.  */
 int screen_number;
@@ -155,6 +177,7 @@ xcb_atom_t ewmh__NET_WM_STATE_FOCUSED; /* atom not in extension */
 
 int randrbase;					/* Beginning of RANDR extension events. */
 int shapebase;					/* Beginning of SHAPE extension events. */
+int syncbase;					/* Beginning of SYNC extension events. */
 
 uint32_t curws = 0;				/* Current workspace. */
 
@@ -162,6 +185,7 @@ int16_t mode_x = 0;
 int16_t mode_y = 0;
 
 list_t *monlist = NULL;			/* List of all physical monitor outputs. */
+monitor_t *curmon = NULL;		/* Monitor showing curws, NULL without RANDR. */
 
 wm_mode_t MCWM_mode = mode_nothing;		/* Internal mode, such as move or resize */
 
@@ -170,10 +194,22 @@ tiling_t tiling_mode = DEFAULT_TILING_MODE; /* global tiling mode */
 bool floating_mode = false; /* global floating mode, overrides tiling_mode */
 
 /*
- * Workspace list: Every workspace has a list of all visible
- * windows.
+ * Workspace list: Every workspace has a tree of all its windows. The
+ * root of a workspace is made on first use and freed when it's empty
+ * and hidden, see ws_tree() and ws_update().
  */
-wtree_t *wslist[WORKSPACES];
+wtree_t **wslist = NULL;
+uint32_t wslen = 0;				/* Length of wslist. */
+uint32_t *occupied = NULL;		/* Bit per workspace with windows on it. */
+uint32_t desktops = 0;			/* _NET_NUMBER_OF_DESKTOPS published. */
+uint32_t tagcount[TAGS];		/* Windows of a workspace also on others. */
+
+/* A workspace being shown or hidden, for wtree_foreach_client() */
+struct view {
+	uint32_t ws;
+	monitor_t *mon;					/* it's shown on */
+	uint64_t tags;					/* workspaces still shown */
+};
 
 /* Shortcut key type and initialization. */
 struct keys {
@@ -226,8 +262,140 @@ struct conf {
 	uint32_t focuscol;		/* Focused border color. */
 	uint32_t unfocuscol;	/* Unfocused border color.  */
 	bool allowicons;		/* Allow windows to be unmapped. */
+	bool outline;			/* Move and resize as outline. */
+	bool reparent;			/* Frame every window, not just shaped ones. */
+	unsigned focusdelay;	/* Milliseconds to dwell before focusing. */
 } conf;
 
+/* Counters for the curious, printed on SIGUSR1. */
+struct stats {
+	uint64_t batches;			/* Event batches run. */
+	uint64_t batch_events;		/* Events in all batches. */
+	unsigned batch_max;			/* Largest batch. */
+
+	uint64_t flushes;			/* Flushes by the event loop, */
+	uint64_t flush_input;		/* after input events, */
+	uint64_t flush_budget;		/* when the time budget ran out, */
+	uint64_t flush_requests;	/* when too many requests were pending, */
+	uint64_t flush_idle;		/* when all events were handled. */
+	uint64_t flush_interval;	/* Sum of time between flushes (usec). */
+	uint64_t flush_interval_max;
+
+	uint64_t steps;				/* Keyboard move/resize steps, */
+	uint64_t steps_applied;		/* and geometry updates they caused. */
+	uint64_t raises_skipped;	/* Restacks that wouldn't change the order. */
+
+	uint64_t drag_motions;		/* Motion events while dragging, */
+	uint64_t drag_applied;		/* and geometry updates they caused. */
+
+	uint64_t enter_ignored;		/* Enter events caused by our layout. */
+	uint64_t focus_avoided;		/* Windows only passed by the pointer. */
+
+	uint64_t layouts;			/* Workspaces laid out, */
+	uint64_t layouts_deferred;	/* and changes to hidden ones saved for later. */
+
+	uint64_t concealed;			/* Tiles unmapped below fullscreen windows, */
+	uint64_t tiles_deferred;	/* and layout changes they missed meanwhile. */
+	uint64_t obscured;			/* Windows published as hidden while covered. */
+
+	uint64_t frame_hits;		/* Frames taken from the pool, */
+	uint64_t frame_misses;		/* and those created as it was empty. */
+} stats;
+
+/* Unmapped frame windows for new clients, see frame_get() and frame_put() */
+struct {
+	xcb_window_t frames[FRAME_POOL];
+	unsigned len;
+} framepool;
+
+/*
+ * Keyboard move and resize steps of the current batch. They are
+ * applied together by apply_steps(), so a run of autorepeated keys
+ * costs one configure and one warp instead of one per key.
+ */
+struct {
+	client_t *client;			/* Client the steps are for. */
+	int dx, dy;					/* Pending move. */
+	int dw, dh;					/* Pending resize. */
+	unsigned count;				/* Steps since last apply. */
+} steps;
+
+/*
+ * Stacking layers, bottom to top. Within its layer a window can be
+ * raised or lowered, it never gets above a window of a higher layer.
+ */
+enum {
+	LAYER_TILED,
+	LAYER_FLOATING,
+	LAYER_FULLSCREEN
+};
+
+list_t *stacklist = NULL;		/* Our windows from top to bottom. */
+bool stack_dirty;				/* client->stacked needs renumbering. */
+
+/* Restacks next to windows that aren't ours, see stack_failed(). */
+#define STACK_RETRIES 16
+struct {
+	unsigned int sequence[STACK_RETRIES];
+	xcb_window_t window[STACK_RETRIES];	/* Window restacked, XCB_NONE if done. */
+	unsigned next;
+} restacks;
+
+/*
+ * Outline of the geometry a client is going to get, see conf.outline.
+ * A pointer drag draws it with XOR on root while the server is
+ * grabbed. Keyboard previews stay up until they are committed, so
+ * nobody is held up for them, they are four thin windows instead.
+ */
+struct {
+	client_t *client;			/* Client of the outline, NULL if none. */
+	xcb_rectangle_t geometry;	/* Geometry to commit. */
+	bool drawn;					/* Outline is on the screen. */
+	bool grabbed;				/* Server grabbed for a pointer drag. */
+	xcb_gcontext_t gc;			/* XOR GC on root. */
+	xcb_window_t edges[4];		/* Windows of keyboard previews. */
+	loop_timer_t commit;		/* Commits keyboard previews. */
+} outline;
+
+/*
+ * Pointer position of a mouse move or resize, applied once per
+ * refresh of the monitor instead of on every motion event.
+ */
+struct {
+	int16_t x, y;				/* Latest root position. */
+	bool dirty;					/* Position not applied yet. */
+	bool active;				/* Button held, until it's released. */
+	loop_timer_t tick;			/* Periodic timer at the refresh rate. */
+} drag;
+
+/*
+ * Request sequence ranges of our own layout changes. Enter events
+ * the server generated while processing them don't come from the
+ * user moving the pointer, see handle_enter_notify.
+ */
+#define LAYOUT_COMMITS 8
+struct {
+	struct {
+		unsigned int start;		/* Sequence before the first request, */
+		unsigned int end;		/* and of the last one. */
+	} range[LAYOUT_COMMITS];
+	unsigned next;				/* Slot for the next range. */
+	unsigned depth;				/* Nesting of layout_begin(). */
+	unsigned int start;			/* Start of the open range. */
+} layout;
+
+/* Window the pointer entered, focused when it stays there, see conf.focusdelay */
+struct {
+	client_t *client;			/* Client to focus, NULL if none. */
+	loop_timer_t timer;			/* Fires after conf.focusdelay. */
+} dwell;
+
+bool occlusion_dirty;			/* Geometry or stacking changed. */
+
+uint64_t last_flush;			/* Time of last flush. */
+unsigned int flush_seq;			/* Request sequence at last flush. */
+unsigned int last_seq;			/* Last request noted, see note_request(). */
+
 /* elemental atoms not in ewmh */
 // JUST USE XCB_WM_NAME_ etc pp?
 struct icccm {
@@ -305,27 +473,59 @@ static void resize_step(client_t *client, step_direction_t direction);
 static void mouse_move(client_t *client, int rel_x, int rel_y);
 static void mouse_resize(client_t *client, int rel_x, int rel_y);
 static void move_step(client_t *client, step_direction_t direction);
+static void apply_steps();
+static void drag_apply();
+static void drag_start(client_t *client);
+static void drag_stop();
+static void setup_outline();
+static void outline_show(client_t *client, const xcb_rectangle_t *geometry);
+static void outline_hide();
+static void outline_commit();
+static void outline_timeout(void *arg);
 
 static void set_to_workspace(client_t *client, uint32_t ws);
 static void move_to_workspace(client_t *client, uint32_t ws);
+static void move_container_to_workspace(client_t *client, uint32_t ws);
 static void remove_from_workspace(client_t *client);
 static void change_workspace(uint32_t ws);
+static void ws_insert(uint32_t ws, wtree_t *node);
+static wtree_t *tag_node(const client_t *client, uint32_t ws);
+static void tag_add(client_t *client, uint32_t ws);
+static void tag_remove(client_t *client, uint32_t ws);
+static void tag_toggle(client_t *client, uint32_t ws);
+static void tag_view(client_t *client, uint32_t ws);
+static uint64_t view_tags();
+static void hide_workspace(uint32_t ws, uint64_t views);
+static void show_workspace(uint32_t ws);
 
 static void update_shape(client_t *client);
+static bool is_shaped(xcb_window_t win);
 static void adjust_stacking(client_t *client);
 static void raise_client(client_t *client);
 static void lower_client(client_t *client);
 static void raise_or_lower_client(client_t *client);
+static void stack_insert(client_t *client);
+static void stack_remove(client_t *client);
+static void stack_number();
+static bool stack_failed(const xcb_generic_error_t *e);
 static void set_focus(client_t *client);
 static void unset_focus();
 static void focus_next();
 static void focus_under_cursor();
+static void dwell_start(client_t *client);
+static void dwell_cancel();
+static void dwell_commit();
+static void dwell_timeout(void *arg);
 
 static void toggle_fullscreen(client_t *client);
 static void toggle_vertical(client_t *client);
 static void unmax(client_t *client);
 
 static void attach_frame(client_t *client);
+static xcb_window_t frame_create(const xcb_rectangle_t *geo, uint16_t border);
+static xcb_window_t frame_get(const xcb_rectangle_t *geo, uint16_t border);
+static void frame_put(xcb_window_t frame);
+static void setup_framepool();
 static void delete_win(client_t*);
 static void hide(client_t *client);
 static void erase_client(client_t *client);
@@ -353,14 +553,33 @@ static bool setup_keys();
 static bool setup_screen();
 static bool setup_ewmh();
 static int setup_randr();
+static int setup_sync();
+static void sync_update_counter(client_t *client);
+static void sync_request(client_t *client);
+static void handle_sync_alarm(xcb_sync_alarm_notify_event_t *e);
+static void sync_free(client_t *client);
+static void sync_done(client_t *client);
+static void resize_synced(client_t *client, const xcb_rectangle_t *geometry);
 static void get_randr();
-static void get_outputs(xcb_randr_output_t * outputs, int len,
+static uint32_t mode_refresh(
+		const xcb_randr_get_screen_resources_current_reply_t *res,
+		xcb_randr_mode_t mode);
+static void get_outputs(const xcb_randr_get_screen_resources_current_reply_t *res,
+		xcb_randr_output_t * outputs, int len,
 					   xcb_timestamp_t timestamp);
 
 static monitor_t *find_monitor(xcb_randr_output_t id);
 static monitor_t *find_clones(xcb_randr_output_t id, int16_t x, int16_t y);
 static monitor_t *find_monitor_at(int16_t x, int16_t y);
 static void del_monitor(monitor_t *mon);
+static void remove_monitor(monitor_t *mon);
+static void assign_workspace(monitor_t *mon);
+static void focus_monitor(monitor_t *mon);
+static void set_monitor(client_t *client, monitor_t *mon);
+static void attach_monitor(client_t *client, monitor_t *mon);
+static monitor_t *ws_monitor(uint32_t ws);
+static bool ws_visible(uint32_t ws);
+static void place_workspace(uint32_t ws, monitor_t *mon);
 static monitor_t *add_monitor(xcb_randr_output_t id, char *name,
 								  uint32_t x, uint32_t y, uint16_t width,
 								  uint16_t height);
@@ -384,7 +603,8 @@ static void next_screen();
 static void configure_win(xcb_window_t win, uint16_t old_mask, winconf_t wc);
 static void events();
 static void print_help();
-static void signal_catch(int sig);
+static void print_stats();
+static void handle_signal(int sig, void *arg);
 
 static void get_monitor_geometry(monitor_t* monitor, xcb_rectangle_t* sp);
 
@@ -398,6 +618,11 @@ static void set_focuswin(uint32_t ws, client_t* client);
 
 /* setup workspace array */
 static void setup_workspaces();
+static wtree_t *ws_root(uint32_t ws);
+static wtree_t *ws_tree(uint32_t ws);
+static void ws_update(uint32_t ws);
+static uint32_t ws_next_occupied(uint32_t ws);
+static void ewmh_update_desktops();
 
 /* update clues in nodes and update screen */
 /* Function bodies. */
@@ -408,9 +633,24 @@ static void toggle_floating(client_t *client);
 
 /* update window sizes below wtree_t */
 static void update_clues(wtree_t *node, xcb_rectangle_t rect);
-
-
-// XXX tiling tmp hack
+static void update_tiles(wtree_t *tiler, xcb_rectangle_t rect);
+static limits_t tile_limits(wtree_t *node, int axis);
+static uint32_t clamp_span(limits_t need, uint32_t span, bool fits);
+static void solve_tiles(wtree_t *tiler, int axis, int length);
+static void fit_limits(wtree_t *node, xcb_rectangle_t *geo);
+static void update_limits(client_t *client);
+static void relayout(uint32_t ws);
+static void relayout_tiles(uint32_t ws, wtree_t *tiler);
+static void resize_tile(client_t *client, int dw, int dh, bool edge);
+static void update_occlusion();
+static void layout_begin();
+static void layout_end();
+static bool layout_caused(const xcb_generic_event_t *ev);
+static unsigned int request_sequence();
+static void note_request(xcb_void_cookie_t cookie);
+
+
+/* The whole root, where workspaces start out before a monitor shows them */
 static xcb_rectangle_t screen_rect()
 {
 	xcb_rectangle_t geo;
@@ -421,6 +661,252 @@ static xcb_rectangle_t screen_rect()
 	return geo;
 }
 
+/*
+ * Start of a layout change, everything until layout_end() may move
+ * windows below the pointer. Calls may nest.
+ */
+void layout_begin()
+{
+	if (layout.depth++ == 0)
+		layout.start = last_seq;
+}
+
+/* End of a layout change, remember its requests. */
+void layout_end()
+{
+	assert(layout.depth > 0);
+
+	if (--layout.depth > 0)
+		return;
+
+	/* Nothing was sent that could move a window */
+	if (last_seq == layout.start)
+		return;
+
+	/*
+	 * What the user does after it comes with the sequence of our
+	 * last request, a NoOperation marks where the layout ends.
+	 */
+	layout.range[layout.next].start = layout.start;
+	layout.range[layout.next].end = request_sequence();
+	layout.next = (layout.next + 1) % LAYOUT_COMMITS;
+}
+
+/* Was ev generated while the server processed one of our layout changes? */
+bool layout_caused(const xcb_generic_event_t *ev)
+{
+	for (unsigned i = 0; i < LAYOUT_COMMITS; i++) {
+		const unsigned int start = layout.range[i].start;
+		const unsigned int end = layout.range[i].end;
+
+		/* not used yet */
+		if (end == start)
+			continue;
+
+		/*
+		 * start < sequence < end, with wrap-around. The NoOperation
+		 * at end only marks it, events from then on were caused by
+		 * the user.
+		 */
+		if (ev->full_sequence - start - 1 < end - start - 1)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Update all tiles of workspace ws. Nobody sees a hidden workspace,
+ * it's only marked dirty and laid out when it's shown.
+ */
+void relayout(uint32_t ws)
+{
+	wtree_t *root = ws_root(ws);
+
+	if (root == NULL)
+		return;
+
+	if (! ws_visible(ws)) {
+		wtree_mark_dirty(root);
+		++stats.layouts_deferred;
+		return;
+	}
+
+	layout_begin();
+	update_clues(root, wtree_screen_geo(root));
+	layout_end();
+
+	wtree_mark_clean(root);
+	++stats.layouts;
+	occlusion_dirty = true;
+}
+
+/* Update the tiles of tiler only, within the space it got last time. */
+void relayout_tiles(uint32_t ws, wtree_t *tiler)
+{
+	/*
+	 * Never laid out, its workspace has to make room for it first.
+	 * The same goes for hidden workspaces, they are done in one go.
+	 */
+	if (! ws_visible(ws) || wtree_tgeo(tiler).width == 0) {
+		relayout(ws);
+		return;
+	}
+
+	layout_begin();
+	update_tiles(tiler, wtree_tgeo(tiler));
+	layout_end();
+
+	occlusion_dirty = true;
+}
+
+/* Is inner completely within outer? */
+static bool rect_contains(const xcb_rectangle_t *outer,
+		const xcb_rectangle_t *inner)
+{
+	return (inner->x >= outer->x && inner->y >= outer->y
+			&& inner->x + inner->width <= outer->x + outer->width
+			&& inner->y + inner->height <= outer->y + outer->height);
+}
+
+/* Area of client's frame including borders. */
+static xcb_rectangle_t frame_rect(const client_t *client)
+{
+	const int border = client->fullscreen ? 0 : conf.borderwidth;
+	xcb_rectangle_t rect = client->tile_pending ?
+		client->tile : client->geometry;
+
+	rect.width += border * 2;
+	rect.height += border * 2;
+	return rect;
+}
+
+/* Is cover a fullscreen window hiding all of client (arg)? */
+static bool covers_client(client_t *cover, void *arg)
+{
+	client_t *client = arg;
+
+	if (cover == client || ! cover->fullscreen || cover->hidden
+			|| cover->conceal)
+		return false;
+
+	const xcb_rectangle_t outer = frame_rect(cover);
+	const xcb_rectangle_t inner = frame_rect(client);
+	return rect_contains(&outer, &inner);
+}
+
+/* Unmap the frame of a tile nobody can see, for reason (CONCEAL_*). */
+static void conceal(client_t *client, uint8_t reason)
+{
+	const bool mapped = ! client->conceal;
+
+	client->conceal |= reason;
+	if (! mapped)
+		return;
+
+	/* Without frame the window itself goes, that's no withdrawal */
+	if (client->frame == client->id) {
+		if (client->hidden)
+			return;
+		client->ignore_unmap = true;
+	}
+
+	PDEBUG("conceal 0x%x\n", client->id);
+	note_request(xcb_unmap_window(conn, client->frame));
+	++stats.concealed;
+}
+
+static void conceal_tab(client_t *client)
+{
+	/* floating windows aren't part of any tab */
+	if (! wtree_is_floating(client->wsitem))
+		conceal(client, CONCEAL_TAB);
+}
+
+/*
+ * Drop reason to conceal client. Once there is none left, map it
+ * again with the tile it got meanwhile.
+ */
+static void reveal(client_t *client, uint8_t reason)
+{
+	if (! (client->conceal & reason))
+		return;
+
+	client->conceal &= ~reason;
+	if (client->conceal)
+		return;
+
+	PDEBUG("reveal 0x%x\n", client->id);
+	if (client->tile_pending) {
+		client->tile_pending = false;
+		update_geometry(client, &client->tile);
+	}
+	if (! client->hidden)
+		note_request(xcb_map_window(conn, client->frame));
+}
+
+/* Is cover stacked above all of client (arg)? */
+static bool obscures_client(client_t *cover, void *arg)
+{
+	client_t *client = arg;
+
+	if (cover == client || cover->hidden || cover->conceal
+			|| cover->stacked <= client->stacked)
+		return false;
+
+	const xcb_rectangle_t outer = frame_rect(cover);
+	const xcb_rectangle_t inner = frame_rect(client);
+	return rect_contains(&outer, &inner);
+}
+
+static void update_occluded(client_t *client)
+{
+	const bool covered = ! (client->fullscreen || client->hidden
+			|| wtree_is_floating(client->wsitem))
+		&& wtree_find_client(wslist[client->ws], &covers_client, client);
+
+	if (covered)
+		conceal(client, CONCEAL_OCCLUDED);
+	else
+		reveal(client, CONCEAL_OCCLUDED);
+
+	/*
+	 * Tell the client if nothing of it can be seen, so it may
+	 * stop rendering. Only a single window above it counts.
+	 */
+	const bool obscured = client->conceal || (! client->hidden
+			&& wtree_find_client(wslist[client->ws], &obscures_client, client));
+
+	if (obscured != client->obscured) {
+		PDEBUG("0x%x is %s\n", client->id, obscured ? "obscured" : "visible");
+		client->obscured = obscured;
+		ewmh_update_state(client);
+		if (obscured)
+			++stats.obscured;
+	}
+}
+
+/*
+ * Conceal the tiles of the shown workspaces that are covered by a
+ * fullscreen window and reveal those that aren't anymore. Publish
+ * _NET_WM_STATE_HIDDEN for all windows covered by another one, going
+ * by our geometry and stacking model.
+ */
+void update_occlusion()
+{
+	occlusion_dirty = false;
+
+	stack_number();
+
+	layout_begin();
+	if (monlist == NULL)
+		wtree_traverse_clients(ws_root(curws), &update_occluded);
+	for (list_t *item = monlist; item; item = item->next) {
+		const monitor_t *mon = item->data;
+		wtree_traverse_clients(ws_root(mon->ws), &update_occluded);
+	}
+	layout_end();
+}
+
 void toggle_floating(client_t *client)
 {
 	if (client == NULL)
@@ -431,7 +917,7 @@ void toggle_floating(client_t *client)
 	if (wtree_toggle_floating(client->wsitem) && ! client->fullscreen)
 		update_geometry(client, &client->geometry_last);
 
-	update_clues(wslist[client->ws], screen_rect());
+	relayout(client->ws);
 	wtree_print_tree(wslist[client->ws]);
 	adjust_stacking(client);
 }
@@ -446,26 +932,124 @@ void toggle_tiling(client_t *client)
 			wtree_set_parent_tiling(client->wsitem, TILING_HORIZONTAL);
 			break;
 		case TILING_HORIZONTAL:
+			wtree_set_parent_tiling(client->wsitem, TILING_TABBED);
+			/* keep the focused one in front */
+			wtree_set_active(client->wsitem);
+			break;
+		case TILING_TABBED:
 			wtree_set_parent_tiling(client->wsitem, TILING_VERTICAL);
 			break;
 	}
 	// XXX tiling, store geometry in tiling nodes
-	update_clues(wslist[client->ws], screen_rect());
+	relayout(client->ws);
 	wtree_print_tree(wslist[client->ws]);
 	adjust_stacking(client);
 }
 
+/* Make room for workspace ws in wslist and occupied. */
+static bool ws_grow(uint32_t ws)
+{
+	uint32_t len = wslen ? wslen : WORKSPACES;
+
+	if (ws < wslen)
+		return true;
+
+	while (len <= ws)
+		len *= 2;
+
+	wtree_t **list = realloc(wslist, len * sizeof(wtree_t*));
+	if (list == NULL)
+		return false;
+	memset(list + wslen, 0, (len - wslen) * sizeof(wtree_t*));
+	wslist = list;
+
+	const uint32_t words = (wslen + 31) / 32;
+	const uint32_t new_words = (len + 31) / 32;
+	uint32_t *bits = realloc(occupied, new_words * sizeof(uint32_t));
+	if (bits == NULL)
+		return false;
+	memset(bits + words, 0, (new_words - words) * sizeof(uint32_t));
+	occupied = bits;
+
+	wslen = len;
+	return true;
+}
+
 void setup_workspaces()
 {
-	for (uint32_t i = 0; i < WORKSPACES; i++)
-		wslist[i] = wtree_new_workspace(screen_rect());
+	if (! ws_grow(WORKSPACES - 1)) {
+		PERROR("Out of memory for workspaces. Exiting.\n");
+		exit(1);
+	}
+}
+
+/* Root of workspace ws, NULL if it's not in use. */
+wtree_t *ws_root(uint32_t ws)
+{
+	return (ws < wslen) ? wslist[ws] : NULL;
+}
+
+/* Root of workspace ws, made on first use. */
+wtree_t *ws_tree(uint32_t ws)
+{
+	xcb_rectangle_t rect;
+
+	assert(ws < WORKSPACES_MAX);
+
+	if (ws < wslen && wslist[ws])
+		return wslist[ws];
+
+	/* It starts out on its monitor or the whole screen if hidden */
+	get_monitor_geometry(ws_monitor(ws), &rect);
+
+	if (! ws_grow(ws) || ! (wslist[ws] = wtree_new_workspace(rect))) {
+		PERROR("Out of memory for workspace %u. Exiting.\n", ws);
+		cleanup(1);
+	}
+	PDEBUG("workspace #%u made\n", ws);
+	return wslist[ws];
+}
+
+/*
+ * Windows came or went on workspace ws. Update its occupied bit and
+ * free it if it's empty and nobody sees it.
+ */
+void ws_update(uint32_t ws)
+{
+	wtree_t *root = ws_root(ws);
+	const uint32_t bit = 1u << (ws % 32);
+
+	if (root && root->child) {
+		occupied[ws / 32] |= bit;
+	} else {
+		if (ws < wslen)
+			occupied[ws / 32] &= ~bit;
+		if (root && ! ws_visible(ws)) {
+			PDEBUG("workspace #%u freed\n", ws);
+			wtree_free(root);
+			wslist[ws] = NULL;
+		}
+	}
+	ewmh_update_desktops();
+}
+
+/* First workspace from ws on with windows on it, wslen if there's none. */
+uint32_t ws_next_occupied(uint32_t ws)
+{
+	while (ws < wslen) {
+		const uint32_t bits = occupied[ws / 32] >> (ws % 32);
+		if (bits)
+			return ws + __builtin_ctz(bits);
+		ws = (ws / 32 + 1) * 32;
+	}
+	return wslen;
 }
 
 /* XXX Don't like that */
 client_t *focuswin(uint32_t ws)
 {
-	assert(ws < WORKSPACES);
-	return wtree_focuswin(wslist[ws]);
+	wtree_t *root = ws_root(ws);
+	return root ? wtree_focuswin(root) : NULL;
 }
 
 
@@ -482,8 +1066,9 @@ void show_node(char* str, wtree_t *node)
 
 void set_focuswin(uint32_t ws, client_t* client)
 {
-	assert(ws < WORKSPACES);
-	wtree_set_focuswin(wslist[ws], client);
+	wtree_t *root = client ? ws_tree(ws) : ws_root(ws);
+	if (root)
+		wtree_set_focuswin(root, client);
 }
 
 /**********************************************************************/
@@ -529,7 +1114,7 @@ void ewmh_update_state(client_t* client)
 		atoms[i++] = ewmh->_NET_WM_STATE_FULLSCREEN;
 	if (client->vertmaxed)
 		atoms[i++] = ewmh->_NET_WM_STATE_MAXIMIZED_VERT;
-	if (client->hidden)
+	if (client->hidden || client->obscured)
 		atoms[i++] = ewmh->_NET_WM_STATE_HIDDEN;
 	if (client == focuswin(curws))
 		atoms[i++] = ewmh__NET_WM_STATE_FOCUSED;
@@ -633,19 +1218,21 @@ void cleanup(int code)
 		xcb_ewmh_connection_wipe(ewmh);
 	}
 	xcb_disconnect(conn);
+	loop_free();
 	exit(code);
 }
 
 /*
- * Rearrange windows to fit new screen size.
+ * Rearrange windows to fit new screen size. Only the shown
+ * workspaces are laid out now, the others when they are shown.
  */
 void arrangewindows()
 {
-	/*
-	 * Go through all windows. If they don't fit on the new screen,
-	 * move them around and resize them as necessary.
-	 */
-	/* TODO tiling */
+	if (monlist == NULL)
+		place_workspace(curws, NULL);
+
+	for (list_t *item = monlist; item; item = item->next)
+		arrbymon(item->data);
 }
 /*
  * set _NET_CLIENT_LIST
@@ -732,96 +1319,496 @@ uint32_t ewmh_get_workspace(xcb_drawable_t win)
 	return ws;
 }
 
-// XXX update_clues does not know about fullscreen, so tries to change windows which shouldn't
-// anyhow, that situation needs to change
-void update_clues(wtree_t *node, xcb_rectangle_t rect)
+static void reveal_tab(client_t *client)
 {
-	if (node == NULL)
-		return;
+	reveal(client, CONCEAL_TAB);
+}
 
-	// root node
-	if (wtree_is_workspace_type(node)) {
-		update_clues(node->child, rect);
-		return;
-	}
+/*
+ * Limits of the tile node along axis, its gaps included. Tiles side
+ * by side add up, stacked ones and tabs need room for the largest.
+ */
+limits_t tile_limits(wtree_t *node, int axis)
+{
+	limits_t need = { 0, 0, 0, 1 };
 
-	if (wtree_is_tiling_type(node) && wtree_tiles(node) > 0) {
-		// tiling node with actual tiles
+	if (wtree_is_client_type(node)) {
+		const uint32_t gaps = 2 * (conf.borderwidth + conf.gapwidth);
+		need = wtree_limits(node, axis);
 
-		xcb_rectangle_t tmp = rect;
-		int tiles = wtree_tiles(node);
-
-		// fix width of the tiling container if there's more than one child
-		if (tiles > 1) {
-			if (wtree_tiling(node) == TILING_VERTICAL)
-				tmp.width /= tiles;
-			if (wtree_tiling(node) == TILING_HORIZONTAL)
-				tmp.height /= tiles;
-		}
-		// jump to the clients
-		update_clues(node->child, tmp);
-	} else if (wtree_is_client_type(node) && ! wtree_is_floating(node)) {
-		int gaps = conf.borderwidth + conf.gapwidth;
-		xcb_rectangle_t tmp = rect;
+		// at least a pixel is left within the gaps
+		need.min = MAX(need.min, 1u) + gaps;
+		need.base += gaps;
+		if (need.max)
+			need.max += gaps;
+		return need;
+	}
 
-		tmp.x += gaps;
-		tmp.y += gaps;
-		assert(tmp.width  > gaps * 2); assert(tmp.height > gaps * 2); // XXX
-		tmp.width  -= gaps * 2;
-		tmp.height -= gaps * 2;
+	const tiling_t tiling = wtree_tiling(node);
+	const bool along = (tiling == TILING_VERTICAL && axis == AXIS_X)
+		|| (tiling == TILING_HORIZONTAL && axis == AXIS_Y);
+	bool unbound = false;
+	int tiles = 0;
 
-		update_geometry(wtree_client(node), &tmp);
-	} else {
-		update_clues(node->next, rect);
-		return;
+	for (wtree_t *child = node->child; child; child = child->next) {
+		if (! wtree_is_tile(child))
+			continue;
+
+		const limits_t lim = tile_limits(child, axis);
+		if (tiles++ == 0) {
+			need = lim;
+		} else if (along) {
+			need.min += lim.min;
+			need.max += lim.max;
+		} else {
+			need.min = MAX(need.min, lim.min);
+			need.max = MAX(need.max, lim.max);
+		}
+		unbound |= (lim.max == 0);
 	}
-	// only either non-floating nodes or tiling-nodes with non-floating nodes get here
-	if (wtree_is_tiling_type(node->parent)) {
-		if (wtree_parent_tiling(node) == TILING_HORIZONTAL)
-			rect.y += rect.height;
-		else if (wtree_parent_tiling(node) == TILING_VERTICAL)
-			rect.x += rect.width;
+	if (unbound)
+		need.max = 0;
+	// increments of several windows don't add up to anything useful
+	if (tiles > 1) {
+		need.base = 0;
+		need.inc = 1;
 	}
-	update_clues(node->next, rect);
+	return need;
 }
 
-
-void move_to_workspace(client_t *client, uint32_t ws)
+/* Span within the limits of need, its min only if fits. */
+static uint32_t clamp_span(limits_t need, uint32_t span, bool fits)
 {
-	if (curws == ws || client == NULL)
-		return;
-
-	hide(client);
-	set_to_workspace(client, ws);
+	if (fits && span < need.min)
+		return need.min;
+	if (need.max && span > need.max)
+		return need.max;
+	return span;
 }
 
-
-void remove_from_workspace(client_t *client)
+/*
+ * Give each tile of tiler its span of length along axis. It gets its
+ * share by favor, unless that's out of its limits. Then it's fixed at
+ * its limit and the others share the rest, until all fit. Spans are
+ * cut to their increments after that. What's left over or missing is
+ * evened out among the tiles that take any size, or the last one.
+ *
+ * When the tiles can't get their min size, they only get their favor.
+ */
+void solve_tiles(wtree_t *tiler, int axis, int length)
 {
-	assert(client != NULL);
+	wtree_t *last = NULL;
+	uint32_t mins = 0;
+	int flexible = 0;
 
-	if (client->ws == WORKSPACE_NONE)
+	for (wtree_t *node = tiler->child; node; node = node->next) {
+		if (! wtree_is_tile(node))
+			continue;
+		const limits_t need = tile_limits(node, axis);
+		wtree_set_need(node, need);
+		wtree_set_span(node, 0);	// not fixed yet
+		mins += need.min;
+		if (need.inc == 1)
+			++flexible;
+		last = node;
+	}
+	if (last == NULL)
 		return;
 
-	/* Is it currently on its workspace */
-	if (focuswin(client->ws) == client)
-		set_focuswin(client->ws, NULL);
+	const bool fits = (mins <= (uint32_t)length);
+	int rest = length;	// for the tiles not fixed yet
+	float sum;
 
-	/* Remove old position and update old tree */
-	wtree_remove(client->wsitem);
-	update_clues(wslist[client->ws], screen_rect());
+	/*
+	 * Only the tiles below their min or only those above their max
+	 * are fixed in one round, whichever the shares are off by more.
+	 * Fixing both could take more than there is.
+	 */
+	for (;;) {
+		int off = 0;	// what the limits add to the shares
+		int taken = 0;
+
+		sum = 0;
+		for (wtree_t *node = tiler->child; node; node = node->next) {
+			if (wtree_is_tile(node) && wtree_span(node) == 0)
+				sum += wtree_favor(node);
+		}
+		if (sum == 0)
+			break;
 
-	client->ws = WORKSPACE_NONE;
-}
+		for (wtree_t *node = tiler->child; node; node = node->next) {
+			if (! wtree_is_tile(node) || wtree_span(node) != 0)
+				continue;
+			const int share = rest * wtree_favor(node) / sum;
+			off += (int)clamp_span(wtree_need(node), share, fits) - share;
+		}
+		if (off == 0)
+			break;
 
-/*
- * set client to one or no workspace
- */
-// XXX: fix for fullsreeen
-void set_to_workspace(client_t *client, uint32_t ws)
+		for (wtree_t *node = tiler->child; node; node = node->next) {
+			if (! wtree_is_tile(node) || wtree_span(node) != 0)
+				continue;
+
+			const int share = rest * wtree_favor(node) / sum;
+			const int span = clamp_span(wtree_need(node), share, fits);
+
+			if ((off > 0 && span > share) || (off < 0 && span < share)) {
+				// never more than there is
+				wtree_set_span(node, MAX(MIN(span, rest - taken), 1));
+				taken += wtree_span(node);
+			}
+		}
+		rest = MAX(rest - taken, 0);
+	}
+
+	/* The rest share by favor, all of them cut to increments */
+	int left = length;
+
+	for (wtree_t *node = tiler->child; node; node = node->next) {
+		if (! wtree_is_tile(node))
+			continue;
+
+		const limits_t need = wtree_need(node);
+		uint32_t span = wtree_span(node);
+
+		if (span == 0 && sum > 0)
+			span = rest * wtree_favor(node) / sum;
+		if (need.inc > 1 && span > need.base) {
+			const uint32_t odd = (span - need.base) % need.inc;
+
+			// down, unless that's below its min
+			if (! fits || span - odd >= need.min)
+				span -= odd;
+			else if (odd)
+				span += need.inc - odd;
+		}
+		wtree_set_span(node, span);
+		left -= span;
+	}
+
+	/* Even it out among those that take any size, within their limits */
+	while (left != 0 && flexible > 0) {
+		const int each = (left / flexible) ? left / flexible : (left > 0 ? 1 : -1);
+
+		flexible = 0;
+		for (wtree_t *node = tiler->child; node && left != 0; node = node->next) {
+			if (! wtree_is_tile(node))
+				continue;
+
+			const limits_t need = wtree_need(node);
+			const int span = wtree_span(node);
+			const int least = fits ? (int)need.min : 1;
+			int change = (left > 0) ? MIN(each, left) : MAX(each, left);
+
+			if (need.inc != 1)
+				continue;
+			if (left > 0 && need.max)
+				change = MIN(change, (int)need.max - span);
+			else if (left < 0)
+				change = MAX(change, least - span);
+			if (change == 0)
+				continue;
+
+			wtree_set_span(node, span + change);
+			left -= change;
+
+			if ((left > 0 && (need.max == 0 || span + change < (int)need.max))
+					|| (left < 0 && span + change > least))
+				++flexible;
+		}
+	}
+
+	/* Nobody takes it, the window of the last tile just won't fill it */
+	if (left != 0)
+		wtree_set_span(last, MAX((int)wtree_span(last) + left, 1));
+}
+
+/*
+ * Split rect among the tiles of tiler, see solve_tiles(). Inactive
+ * tabs are neither mapped nor laid out until they are shown.
+ */
+void update_tiles(wtree_t *tiler, xcb_rectangle_t rect)
+{
+	const tiling_t tiling = wtree_tiling(tiler);
+	int offset = (tiling == TILING_VERTICAL) ? rect.x : rect.y;
+	wtree_t *active = NULL;
+
+	// remember it, to lay out just this container later
+	wtree_set_tgeo(tiler, rect);
+
+	if (tiling == TILING_TABBED)
+		active = wtree_active(tiler);
+	else if (tiling == TILING_VERTICAL)
+		solve_tiles(tiler, AXIS_X, rect.width);
+	else
+		solve_tiles(tiler, AXIS_Y, rect.height);
+
+	for (wtree_t *node = tiler->child; node; node = node->next) {
+		xcb_rectangle_t tmp = rect;
+
+		if (! wtree_is_tile(node)) {
+			update_clues(node, rect);
+			continue;
+		}
+
+		if (tiling == TILING_TABBED) {
+			// all tabs get the whole rect
+			if (node != active) {
+				wtree_traverse_subtree(node, &conceal_tab);
+				continue;
+			}
+		} else if (tiling == TILING_VERTICAL) {
+			tmp.x = offset;
+			tmp.width = wtree_span(node);
+			offset += tmp.width;
+		} else {
+			tmp.y = offset;
+			tmp.height = wtree_span(node);
+			offset += tmp.height;
+		}
+		update_clues(node, tmp);
+	}
+}
+
+/*
+ * Cut the size of a tiled window down to what it takes, so it doesn't
+ * fight over it. It stays in the top left corner of its tile.
+ */
+void fit_limits(wtree_t *node, xcb_rectangle_t *geo)
+{
+	uint16_t *size[2] = { &geo->width, &geo->height };
+
+	for (int axis = AXIS_X; axis <= AXIS_Y; axis++) {
+		const limits_t lim = wtree_limits(node, axis);
+
+		if (lim.max && *size[axis] > lim.max)
+			*size[axis] = lim.max;
+		if (lim.inc > 1 && *size[axis] > lim.base)
+			*size[axis] -= (*size[axis] - lim.base) % lim.inc;
+	}
+}
+
+// XXX update_clues does not know about fullscreen, so tries to change windows which shouldn't
+// anyhow, that situation needs to change
+void update_clues(wtree_t *node, xcb_rectangle_t rect)
+{
+	if (node == NULL)
+		return;
+
+	// root node
+	if (wtree_is_workspace_type(node)) {
+		update_clues(node->child, rect);
+		return;
+	}
+
+	if (wtree_is_tiling_type(node) && wtree_tiles(node) > 0) {
+		// tiling node with actual tiles
+		update_tiles(node, rect);
+	} else if (wtree_is_client_type(node) && ! wtree_is_floating(node)) {
+		int gaps = conf.borderwidth + conf.gapwidth;
+		xcb_rectangle_t tmp = rect;
+
+		tmp.x += gaps;
+		tmp.y += gaps;
+		assert(tmp.width  > gaps * 2); assert(tmp.height > gaps * 2); // XXX
+		tmp.width  -= gaps * 2;
+		tmp.height -= gaps * 2;
+		fit_limits(node, &tmp);
+
+		client_t *client = wtree_client(node);
+
+		/* Shown on another of its workspaces, this tile stays empty */
+		if (client->wsitem != node)
+			return;
+
+		/* Nobody sees it, it gets its tile when it's revealed */
+		if (client->conceal & ~CONCEAL_TAB) {
+			client->tile = tmp;
+			client->tile_pending = true;
+			++stats.tiles_deferred;
+		} else {
+			client->tile_pending = false;
+			update_geometry(client, &tmp);
+		}
+		/* an active tab now, if it wasn't before */
+		reveal(client, CONCEAL_TAB);
+	} else {
+		/* floating windows are never part of a tab */
+		wtree_traverse_subtree(node, &reveal_tab);
+	}
+}
+
+
+void move_to_workspace(client_t *client, uint32_t ws)
+{
+	if (client == NULL || client->ws == ws || ws >= WORKSPACES_MAX)
+		return;
+
+	/* On a workspace of another monitor it stays mapped */
+	if (! ws_visible(ws))
+		hide(client);
+	set_to_workspace(client, ws);
+	if (client->hidden && ws_visible(ws))
+		show(client);
+}
+
+
+/* A container moving from one workspace to another, see moved_client() */
+struct move {
+	uint32_t from;
+	uint32_t to;
+};
+
+/*
+ * Client's node in a container moved from move->from to move->to. It
+ * goes along if it was shown there.
+ */
+static void moved_client(client_t *client, void *arg)
+{
+	const struct move *move = arg;
+	const uint32_t from = move->from;
+	const uint32_t to = move->to;
+
+	if (focuswin(from) == client)
+		set_focuswin(from, NULL);
+
+	/* Already there with another node, this one takes over */
+	if (client->tags & TAG(to))
+		tag_remove(client, to);
+	/* Only the first TAGS workspaces have room for more */
+	if (client->tagitems && to >= TAGS) {
+		uint64_t others = client->tags & ~TAG(from);
+		while (others) {
+			tag_remove(client, __builtin_ctzll(others));
+			others &= others - 1;
+		}
+	}
+
+	if (client->tagitems) {
+		/* Keep the nodes in order of the bits */
+		const uint32_t tags = __builtin_popcountll(client->tags);
+		const uint32_t i = __builtin_popcountll(client->tags & (TAG(from) - 1));
+		wtree_t *node = client->tagitems[i];
+
+		memmove(client->tagitems + i, client->tagitems + i + 1,
+				(tags - i - 1) * sizeof(wtree_t*));
+		client->tags &= ~TAG(from);
+
+		const uint32_t j = __builtin_popcountll(client->tags & (TAG(to) - 1));
+		memmove(client->tagitems + j + 1, client->tagitems + j,
+				(tags - j - 1) * sizeof(wtree_t*));
+		client->tagitems[j] = node;
+		client->tags |= TAG(to);
+
+		--tagcount[from];
+		++tagcount[to];
+	} else {
+		client->tags = TAG(to);
+	}
+
+	if (client->ws != from)
+		return;
+
+	client->ws = to;
+	xcb_ewmh_set_wm_desktop(ewmh, client->id, to);
+
+	if (! ws_visible(to)) {
+		hide(client);
+		return;
+	}
+
+	monitor_t *mon = ws_monitor(to);
+	if (mon && client->monitor)
+		set_monitor(client, mon);
+	if (client->hidden)
+		show(client);
+}
+
+/*
+ * Move the container client is in to ws, with all its windows at
+ * once. Each workspace is laid out once.
+ */
+void move_container_to_workspace(client_t *client, uint32_t ws)
+{
+	if (client == NULL || client->ws == ws || ws >= WORKSPACES_MAX)
+		return;
+
+	const uint32_t from = client->ws;
+	struct move move = { from, ws };
+	wtree_t *container = client->wsitem->parent;
+
+	assert(container != NULL && wtree_is_tiling_type(container));
+
+	PDEBUG("move container %p from workspace #%u to #%u\n",
+			(void*)container, from, ws);
+
+	layout_begin();
+
+	/* Splice it out, empty tiling-nodes above it go */
+	wtree_remove(container);
+	/* Its size was relative to its old siblings */
+	wtree_set_favor(container, 1.0f);
+
+	/* Before anything is put in front of it there */
+	wtree_foreach_client(container, &moved_client, &move);
+
+	ws_insert(ws, container);
+
+	relayout(from);
+	relayout(ws);
+
+	layout_end();
+
+	ws_update(from);
+	ws_update(ws);
+
+	/*
+	 * The focus went along. The enter events of the layout are
+	 * ignored, so nothing on the workspace left behind would get it.
+	 */
+	if (from == curws && focuswin(curws) == NULL)
+		focus_next();
+
+	wtree_print_tree(ws_root(ws));
+	xcb_flush(conn);
+}
+
+void remove_from_workspace(client_t *client)
 {
 	assert(client != NULL);
-	assert(ws < WORKSPACES);
+
+	if (client->ws == WORKSPACE_NONE)
+		return;
+
+	/* Off all others first, they only hold a node each */
+	uint64_t others = client->tags & ~TAG(client->ws);
+	while (others) {
+		tag_remove(client, __builtin_ctzll(others));
+		others &= others - 1;
+	}
+
+	/* Is it currently on its workspace */
+	if (focuswin(client->ws) == client)
+		set_focuswin(client->ws, NULL);
+
+	/* Remove old position and update old tree */
+	wtree_remove(client->wsitem);
+	relayout(client->ws);
+
+	const uint32_t ws = client->ws;
+	client->ws = WORKSPACE_NONE;
+	client->tags = 0;
+	ws_update(ws);
+}
+
+/*
+ * set client to one or no workspace
+ */
+// XXX: fix for fullsreeen
+void set_to_workspace(client_t *client, uint32_t ws)
+{
+	assert(client != NULL);
+	assert(ws < WORKSPACES_MAX);
 
 	PDEBUG("set workspace for 0x%x to %u\n", client->id, ws);
 
@@ -831,20 +1818,55 @@ void set_to_workspace(client_t *client, uint32_t ws)
 	remove_from_workspace(client);
 
 	client->ws = ws;
+	client->tags = TAG(ws);
+
+	wtree_t *root = ws_tree(ws);
+	wtree_t *node = client->wsitem;
+
+	ws_insert(ws, node);
+
+	/* Shown on a monitor, the client moves over. New ones get placed later */
+	monitor_t *mon = ws_monitor(ws);
+	if (mon && client->monitor)
+		set_monitor(client, mon);
+
+	/* Set _NET_WM_DESKTOP accordingly or leave it  */
+	xcb_ewmh_set_wm_desktop(ewmh, client->id, ws);
+	ws_update(ws);
+
+	// fixup geometries in tree
+	if (! (wtree_is_floating(node) || client->fullscreen))
+		relayout(ws);
+
+	wtree_print_tree(root);
 
+	xcb_flush(conn);
+}
+
+/*
+ * Put node into the tree of ws, next to its focused window or on top
+ * if there is none.
+ */
+void ws_insert(uint32_t ws, wtree_t *node)
+{
 	/* new workspace to be added to */
 	/* Is there a focused window we can add to ? */
-	wtree_t *node = client->wsitem;
+	wtree_t *root = ws_tree(ws);
 	client_t *focus = focuswin(ws);
+	/* Its node here, it might be shown on another workspace */
+	wtree_t *item = focus ? tag_node(focus, ws) : NULL;
 
 	/* Check for active window */
 	if (focus == NULL) {
 		/* Attach client to root */
-		if (wslist[ws]->child == NULL) {
+		if (root->child == NULL && wtree_is_tiling_type(node)) {
+			/* A container becomes the tiling-node on root. */
+			wtree_append_child(root, node);
+		} else if (root->child == NULL) {
 			/* No tiling-node on root, attach tiling-node with node. */
-			wtree_append_tile_child(wslist[ws], node, tiling_mode);
+			wtree_append_tile_child(root, node, tiling_mode);
 		} else {
-			tree_t *parent = wslist[ws]->child;
+			tree_t *parent = root->child;
 
 			if (wtree_tiling(parent) == tiling_mode) {
 				/* Tiling-node on root with the same tiling, append. */
@@ -865,35 +1887,243 @@ void set_to_workspace(client_t *client, uint32_t ws)
 		}
 	} else {
 		/* Attach to active window */
-		if (wtree_parent_tiling(focus->wsitem) != tiling_mode) {
+		if (wtree_parent_tiling(item) != tiling_mode) {
 			/* Tiling-node of focuswin with different tiling,
 			   - on singleton: change tiling-mode and add to
 			   - on siblings : replace focuswin with tiling-node
 			     and add as sibling
 			*/
-			if (focus->wsitem->next == NULL && focus->wsitem->prev == NULL)
-				wtree_set_parent_tiling(focus->wsitem, tiling_mode);
+			if (item->next == NULL && item->prev == NULL)
+				wtree_set_parent_tiling(item, tiling_mode);
 			else
-				wtree_inter_tile(focus->wsitem, tiling_mode);
+				wtree_inter_tile(item, tiling_mode);
 		}
-		wtree_add_sibling(focus->wsitem, node);
+		wtree_add_sibling(item, node);
 	}
-	/* Set _NET_WM_DESKTOP accordingly or leave it  */
-	xcb_ewmh_set_wm_desktop(ewmh, client->id, ws);
+	/* a new tab is shown in front */
+	wtree_set_active(node);
+}
+
+/* Node of client in the tree of ws, one of its tags. */
+wtree_t *tag_node(const client_t *client, uint32_t ws)
+{
+	if (client->tagitems == NULL) {
+		assert(ws == client->ws);
+		return client->wsitem;
+	}
+	assert(client->tags & TAG(ws));
+
+	/* They are in order of the bits, so count the ones below */
+	return client->tagitems[__builtin_popcountll(client->tags & (TAG(ws) - 1))];
+}
+
+/*
+ * Put client on workspace ws too, with a node of its own there. It's
+ * laid out only on the workspace it's shown on, see tag_view().
+ */
+void tag_add(client_t *client, uint32_t ws)
+{
+	wtree_t **items;
+	wtree_t *node;
+
+	if (client == NULL || client->ws >= TAGS || ws >= TAGS
+			|| (client->tags & TAG(ws)))
+		return;
+
+	const uint32_t tags = __builtin_popcountll(client->tags);
+
+	if (! (items = realloc(client->tagitems, (tags + 1) * sizeof(wtree_t*)))) {
+		perror("wmwm tag_add");
+		return;
+	}
+	if (client->tagitems == NULL)
+		items[0] = client->wsitem;
+	client->tagitems = items;
+
+	if (! (node = wtree_new_client(client, wtree_is_floating(client->wsitem)))) {
+		perror("wmwm tag_add");
+		return;
+	}
+	wtree_set_limits(node, AXIS_X, wtree_limits(client->wsitem, AXIS_X));
+	wtree_set_limits(node, AXIS_Y, wtree_limits(client->wsitem, AXIS_Y));
+
+	const uint32_t i = __builtin_popcountll(client->tags & (TAG(ws) - 1));
+	memmove(items + i + 1, items + i, (tags - i) * sizeof(wtree_t*));
+	items[i] = node;
+
+	client->tags |= TAG(ws);
+	if (tags == 1)
+		++tagcount[client->ws];
+	++tagcount[ws];
+
+	PDEBUG("tag 0x%x with workspace #%u\n", client->id, ws);
+
+	ws_insert(ws, node);
+	ws_update(ws);
 
-	// fixup geometries in tree
 	if (! (wtree_is_floating(node) || client->fullscreen))
-		update_clues(wslist[ws], screen_rect());
+		relayout(ws);
+}
+
+/*
+ * Take client off workspace ws, unless it's the last one it's on. If
+ * it was shown there, it's shown on another of its workspaces now.
+ */
+void tag_remove(client_t *client, uint32_t ws)
+{
+	if (client == NULL || client->tagitems == NULL || ! (client->tags & TAG(ws)))
+		return;
 
-	wtree_print_tree(wslist[ws]);
+	const uint32_t tags = __builtin_popcountll(client->tags);
+	const uint32_t i = __builtin_popcountll(client->tags & (TAG(ws) - 1));
+	wtree_t *node = client->tagitems[i];
 
-	xcb_flush(conn);
+	if (client->ws == ws) {
+		/* Rather one that's shown right now */
+		const uint64_t others = client->tags & ~TAG(ws);
+		const uint64_t shown = others & view_tags();
+		const bool visible = ! client->hidden;
+
+		tag_view(client, __builtin_ctzll(shown ? shown : others));
+		if (visible && ! shown)
+			hide(client);
+		else if (! visible && shown)
+			show(client);
+		relayout(client->ws);
+	}
+
+	if (focuswin(ws) == client)
+		set_focuswin(ws, NULL);
+
+	wtree_remove(node);
+	wtree_free(node);
+
+	memmove(client->tagitems + i, client->tagitems + i + 1,
+			(tags - i - 1) * sizeof(wtree_t*));
+	client->tags &= ~TAG(ws);
+	--tagcount[ws];
+	if (tags == 2) {
+		--tagcount[client->ws];
+		destroy(client->tagitems);
+	}
+
+	PDEBUG("untag 0x%x from workspace #%u\n", client->id, ws);
+
+	relayout(ws);
+	ws_update(ws);
+}
+
+void tag_toggle(client_t *client, uint32_t ws)
+{
+	if (client == NULL)
+		return;
+
+	if (client->tags & TAG(ws))
+		tag_remove(client, ws);
+	else
+		tag_add(client, ws);
+}
+
+/*
+ * Show client on ws from now on, one of its tags. Showing or hiding
+ * it is up to the caller, its tile is laid out with the next layout
+ * of ws.
+ */
+void tag_view(client_t *client, uint32_t ws)
+{
+	wtree_t *node = tag_node(client, ws);
+
+	if (client->ws == ws)
+		return;
+
+	PDEBUG("0x%x shown on workspace #%u now\n", client->id, ws);
+
+	/* It was made floating or tiled on the other one */
+	if (wtree_is_floating(node) != wtree_is_floating(client->wsitem))
+		wtree_toggle_floating(node);
+
+	client->wsitem = node;
+	client->ws = ws;
+
+	monitor_t *mon = ws_monitor(ws);
+	if (mon && client->monitor)
+		set_monitor(client, mon);
+
+	wtree_mark_dirty(ws_root(ws));
+	xcb_ewmh_set_wm_desktop(ewmh, client->id, ws);
+}
+
+/* TAG() of all workspaces that are shown. */
+uint64_t view_tags()
+{
+	uint64_t tags = TAG(curws);
+
+	for (list_t *item = monlist; item; item = item->next)
+		tags |= TAG(((monitor_t*)item->data)->ws);
+	return tags;
+}
+
+/*
+ * Hide client, unless it's on a workspace that is still shown. If it
+ * was shown on the one going away, it moves over there.
+ */
+static void hide_untagged(client_t *client, void *arg)
+{
+	const struct view *view = arg;
+	const uint64_t shown = client->tags & view->tags;
+
+	if (shown == 0) {
+		hide(client);
+	} else if (client->ws == view->ws) {
+		const uint32_t ws = __builtin_ctzll(shown);
+		tag_view(client, ws);
+		relayout(ws);
+	}
+}
+
+/* Hide the windows of ws, but not those also on a workspace of views. */
+void hide_workspace(uint32_t ws, uint64_t views)
+{
+	if (ws >= TAGS || tagcount[ws] == 0) {
+		wtree_traverse_clients(ws_root(ws), &hide);
+	} else {
+		struct view view = { ws, NULL, views };
+		wtree_foreach_client(ws_root(ws), &hide_untagged, &view);
+	}
+}
+
+static void show_viewed(client_t *client, void *ws)
+{
+	if (client->ws == *(uint32_t*)ws)
+		show(client);
+}
+
+/* Show the windows of ws, but not those shown on another workspace. */
+void show_workspace(uint32_t ws)
+{
+	if (ws >= TAGS || tagcount[ws] == 0)
+		wtree_traverse_clients(ws_root(ws), &show);
+	else
+		wtree_foreach_client(ws_root(ws), &show_viewed, &ws);
 }
 
 /* Change current workspace to ws. */
 void change_workspace(uint32_t ws)
 {
-	if (ws == curws) {
+	const uint32_t old = curws;
+
+	if (ws == curws || ws >= WORKSPACES_MAX) {
+		return;
+	}
+
+	/* Shown on another monitor already, go over there */
+	monitor_t *mon = ws_monitor(ws);
+	if (mon) {
+		focus_monitor(mon);
+		xcb_warp_pointer(conn, XCB_WINDOW_NONE, screen->root, 0, 0, 0, 0,
+				mon->x + mon->width / 2, mon->y + mon->height / 2);
+		dwell_cancel();
+		focus_under_cursor();
 		return;
 	}
 
@@ -905,27 +2135,36 @@ void change_workspace(uint32_t ws)
 	 */
 	unset_focus();
 
-	/* Apply hidden window event mask, this ensures no invalid enter events */
-	wtree_traverse_clients(wslist[curws], &set_hidden_events);
+	/* Enter events of the windows we show or hide are no user's doing */
+	layout_begin();
 
-	/* Go through list of current ws. Unmap everything that isn't fixed. */
-	wtree_traverse_clients(wslist[curws], &hide);
+	/* Go through list of current ws. Unmap everything that isn't fixed.
+	 * Only windows of our monitor are touched. */
+	hide_workspace(curws, (view_tags() & ~TAG(curws)) | TAG(ws));
 
 	/* Set the new current workspace */
 	xcb_ewmh_set_current_desktop(ewmh, screen_number, ws);
 
 	curws = ws;
+	if (curmon)
+		curmon->ws = ws;
+
+	/* Catch up with what changed while it was hidden, before mapping */
+	place_workspace(ws, curmon);
 
 	/* Go through list of new ws and map everything */
-	wtree_traverse_clients(wslist[curws], &show);
+	show_workspace(curws);
+
+	layout_end();
 
-	/* Re-enable enter events */
-	wtree_traverse_clients(wslist[curws], &set_default_events);
+	/* Nobody sees the old one now, free it if it's empty */
+	ws_update(old);
 
 	/* Map the windows now */
 	xcb_flush(conn);
 
 	/* Set focus on the window under the mouse */
+	dwell_cancel();
 	focus_under_cursor();
 }
 
@@ -1053,8 +2292,12 @@ int update_geometry(client_t *client,
 
 
 out: ;
-	uint32_t values[2];
-	uint16_t value_mask = 0;
+	/*
+	 * The client is put back at 0,0 in its frame on resizes, its own
+	 * win gravity may have moved it when the frame was resized.
+	 */
+	uint32_t values[4] = { 0, 0 };
+	uint16_t value_mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
 	uint32_t frame_values[4];
 	uint16_t frame_value_mask = 0;
 	int cm = 0; // window modified
@@ -1071,14 +2314,14 @@ out: ;
 	if (client->geometry.width != geo.width) {
 		value_mask |= XCB_CONFIG_WINDOW_WIDTH;
 		frame_value_mask |= XCB_CONFIG_WINDOW_WIDTH;
-		values[cm++] = geo.width;
+		values[2 + cm++] = geo.width;
 		frame_values[fm++] = geo.width;
 	}
 
 	if (client->geometry.height != geo.height) {
 		value_mask |= XCB_CONFIG_WINDOW_HEIGHT;
 		frame_value_mask |= XCB_CONFIG_WINDOW_HEIGHT;
-		values[cm++] = geo.height;
+		values[2 + cm++] = geo.height;
 		frame_values[fm++] = geo.height;
 	}
 
@@ -1092,20 +2335,30 @@ out: ;
 			geo.width, geo.height);
 
 	client->geometry = geo;
+	occlusion_dirty = true;
+
+	/* client modified (resize), it's asked to tell when it's done */
+	if (cm && client->sync.request)
+		sync_request(client);
 
 	/* frame modified (move || resize) */
 	if (fm)
-		xcb_configure_window(conn, client->frame, frame_value_mask,
-				frame_values);
+		note_request(xcb_configure_window(conn, client->frame, frame_value_mask,
+				frame_values));
 
-	/* client modified (resize) */
-	if (cm)
-		xcb_configure_window(conn, client->id, value_mask, values);
+	/* client modified (resize), unless it's its own frame */
+	if (cm && client->frame != client->id)
+		note_request(xcb_configure_window(conn, client->id, value_mask, values));
 
-	/* send information about geometry change to client */
-	if (fm > 0 || cm > 0) {
+	/*
+	 * Send information about geometry change to client. A client
+	 * dragged around only learns its final position, when the drag
+	 * is done, see handle_button_release.
+	 */
+	if (cm == 0 && is_mode(mode_move) && client == focuswin(curws))
+		client->configure_pending = true;
+	else
 		send_configuration(client);
-	}
 
 	return 1;
 }
@@ -1162,10 +2415,12 @@ void new_win(xcb_window_t win)
 			 * in that case just use x,y given in initialization */
 			PDEBUG("User set coordinates: %d,%d\n", geometry.x, geometry.y);
 		} else if (client->modal) {
+			xcb_rectangle_t mon;
+
 			PDEBUG("Modal window, center!\n");
-			// XXX hack, see below (monitor)
-			geometry.x = screen_rect().width / 2 - client->geometry.width / 2;
-			geometry.y = screen_rect().height / 2 - client->geometry.height / 2;
+			get_monitor_geometry(curmon, &mon);
+			geometry.x = mon.x + mon.width / 2 - client->geometry.width / 2;
+			geometry.y = mon.y + mon.height / 2 - client->geometry.height / 2;
 		} else {
 			int16_t pointx;
 			int16_t pointy;
@@ -1185,14 +2440,19 @@ void new_win(xcb_window_t win)
 	/* Find the physical output this window will be on if RANDR
 	   is active. */
 	if (-1 != randrbase) {
-		client->monitor = find_monitor_at(geometry.x, geometry.y);
-		if (! client->monitor) {
+		/* Tiles are on the monitor of their workspace */
+		monitor_t *mon = curmon;
+
+		if (wtree_is_floating(client->wsitem) && ! client->fullscreen)
+			mon = find_monitor_at(geometry.x, geometry.y);
+		if (! mon) {
 			/*
 			 * Window coordinates are outside all physical monitors.
 			 * Choose the first screen.
 			 */
-			if (monlist) client->monitor = monlist->data;
+			if (monlist) mon = monlist->data;
 		}
+		attach_monitor(client, mon);
 	}
 
 	if (wtree_is_floating(client->wsitem) || client->fullscreen)
@@ -1229,6 +2489,7 @@ void icccm_update_wm_normal_hints(client_t* client)
 			 	hints, NULL)) {
 		memset(hints, 0, sizeof(xcb_size_hints_t));
 		PDEBUG("Couldn't get size hints.\n");
+		update_limits(client);
 		return;
 	}
 
@@ -1263,6 +2524,42 @@ void icccm_update_wm_normal_hints(client_t* client)
 		if (hints->height_inc < 1)
 			hints->height_inc = 1;
 	}
+
+	update_limits(client);
+}
+
+/* Keep the size limits of WM_NORMAL_HINTS with the nodes of client. */
+void update_limits(client_t *client)
+{
+	const xcb_size_hints_t *hints = &client->hints;
+	limits_t lim[2] = { { 0, 0, 0, 1 }, { 0, 0, 0, 1 } };
+
+	if (client->wsitem == NULL)
+		return;
+
+	if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+		lim[AXIS_X].min = MAX(hints->min_width, 0);
+		lim[AXIS_Y].min = MAX(hints->min_height, 0);
+	}
+	if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
+		lim[AXIS_X].max = MAX(hints->max_width, 0);
+		lim[AXIS_Y].max = MAX(hints->max_height, 0);
+	}
+	if (hints->flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC) {
+		lim[AXIS_X].base = MAX(hints->base_width, 0);
+		lim[AXIS_Y].base = MAX(hints->base_height, 0);
+		lim[AXIS_X].inc = hints->width_inc;
+		lim[AXIS_Y].inc = hints->height_inc;
+	}
+
+	const uint32_t nodes = client->tagitems
+		? __builtin_popcountll(client->tags) : 1;
+
+	for (uint32_t i = 0; i < nodes; i++) {
+		wtree_t *node = client->tagitems ? client->tagitems[i] : client->wsitem;
+		wtree_set_limits(node, AXIS_X, lim[AXIS_X]);
+		wtree_set_limits(node, AXIS_Y, lim[AXIS_Y]);
+	}
 }
 
 /*
@@ -1296,6 +2593,7 @@ void icccm_update_wm_protocols(client_t* client)
 {
 	xcb_get_property_cookie_t cookie;
 	xcb_icccm_get_wm_protocols_reply_t protocols;
+	bool sync_request = false;
 
 	cookie = xcb_icccm_get_wm_protocols_unchecked(conn, client->id,
 			icccm.wm_protocols);
@@ -1313,9 +2611,165 @@ void icccm_update_wm_protocols(client_t* client)
 				client->take_focus = true;
 				continue;
 			}
+			if (protocols.atoms[i] == ewmh->_NET_WM_SYNC_REQUEST) {
+				sync_request = true;
+				continue;
+			}
 		}
 		xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
 	}
+
+	if (sync_request && syncbase != -1)
+		sync_update_counter(client);
+	else
+		sync_free(client);
+}
+
+/*
+ * Get the counter of _NET_WM_SYNC_REQUEST_COUNTER and set up an
+ * alarm on it, that tells us when the client has caught up.
+ */
+void sync_update_counter(client_t *client)
+{
+	xcb_get_property_reply_t *reply;
+	xcb_sync_counter_t counter = XCB_NONE;
+
+	reply = xcb_get_property_reply(conn,
+			xcb_get_property_unchecked(conn, false, client->id,
+				ewmh->_NET_WM_SYNC_REQUEST_COUNTER, XCB_ATOM_CARDINAL, 0, 1),
+			NULL);
+
+	/* the first counter is the basic one, ignore an extended one */
+	if (reply && reply->format == 32
+			&& xcb_get_property_value_length(reply) >= 4)
+		counter = *(uint32_t*)xcb_get_property_value(reply);
+	destroy(reply);
+
+	if (counter == client->sync.counter)
+		return;
+
+	sync_free(client);
+	if (counter == XCB_NONE)
+		return;
+
+	/* Our requests count on from where the client's counter is now */
+	xcb_sync_query_counter_reply_t *current = xcb_sync_query_counter_reply(conn,
+			xcb_sync_query_counter(conn, counter), NULL);
+	if (current == NULL) {
+		PDEBUG("0x%x has no valid sync counter 0x%x\n", client->id, counter);
+		return;
+	}
+	const uint64_t value = (uint64_t)(uint32_t)current->counter_value.hi << 32
+		| current->counter_value.lo;
+	destroy(current);
+
+	PDEBUG("0x%x has sync counter 0x%x at %" PRIu64 "\n", client->id,
+			counter, value);
+
+	/* alarm when counter >= value, deactivated after firing */
+	const uint32_t values[] = {
+		counter,
+		XCB_SYNC_VALUETYPE_ABSOLUTE,
+		value >> 32, value & 0xffffffff,
+		XCB_SYNC_TESTTYPE_POSITIVE_COMPARISON,
+		0, 0,	/* delta, hi and lo */
+		true	/* events */
+	};
+
+	client->sync.counter = counter;
+	client->sync.value = value;
+	client->sync.alarm = xcb_generate_id(conn);
+	xcb_sync_create_alarm(conn, client->sync.alarm,
+			XCB_SYNC_CA_COUNTER | XCB_SYNC_CA_VALUE_TYPE | XCB_SYNC_CA_VALUE
+			| XCB_SYNC_CA_TEST_TYPE | XCB_SYNC_CA_DELTA | XCB_SYNC_CA_EVENTS,
+			values);
+}
+
+/* Forget about client's sync counter. */
+void sync_free(client_t *client)
+{
+	loop_timer_cancel(client->sync.timeout);
+	client->sync.timeout = 0;
+
+	if (client->sync.alarm != XCB_NONE)
+		xcb_sync_destroy_alarm(conn, client->sync.alarm);
+
+	client->sync.counter = XCB_NONE;
+	client->sync.alarm = XCB_NONE;
+	client->sync.request = false;
+	client->sync.waiting = false;
+	client->sync.pending = false;
+}
+
+static void sync_timeout(void *arg)
+{
+	client_t *client = arg;
+
+	PDEBUG("0x%x didn't answer sync request %" PRIu64 "\n",
+			client->id, client->sync.value);
+	client->sync.timeout = 0;
+	sync_done(client);
+}
+
+/*
+ * Ask client to update its counter once it handled the next
+ * ConfigureNotify. Sent right before the resize.
+ */
+void sync_request(client_t *client)
+{
+	const uint64_t value = ++client->sync.value;
+	const uint32_t alarm_value[] = { value >> 32, value & 0xffffffff };
+
+	xcb_client_message_event_t ev = {
+		.response_type = XCB_CLIENT_MESSAGE,
+		.format = 32,
+		.sequence = 0,
+		.window = client->id,
+		.type = icccm.wm_protocols,
+		.data.data32 = {
+			ewmh->_NET_WM_SYNC_REQUEST, get_timestamp(),
+			value & 0xffffffff, value >> 32, 0
+		}
+	};
+	note_request(xcb_send_event(conn, false, client->id,
+			XCB_EVENT_MASK_NO_EVENT, (char *) &ev));
+
+	/* changing the alarm activates it again */
+	xcb_sync_change_alarm(conn, client->sync.alarm, XCB_SYNC_CA_VALUE,
+			alarm_value);
+
+	client->sync.waiting = true;
+	loop_timer_cancel(client->sync.timeout);
+	client->sync.timeout = loop_timer_add(SYNC_TIMEOUT * 1000, 0,
+			sync_timeout, client);
+}
+
+/* Client caught up (or we gave up), resize to what has been waiting. */
+void sync_done(client_t *client)
+{
+	client->sync.waiting = false;
+	loop_timer_cancel(client->sync.timeout);
+	client->sync.timeout = 0;
+
+	if (client->sync.pending && is_mode(mode_resize)) {
+		client->sync.pending = false;
+		resize_synced(client, &client->sync.geometry);
+	}
+}
+
+/* Is the alarm for the resize we are waiting for? */
+void handle_sync_alarm(xcb_sync_alarm_notify_event_t *e)
+{
+	client_t *client = focuswin(curws);
+	const uint64_t value = (uint64_t)(uint32_t)e->counter_value.hi << 32
+		| e->counter_value.lo;
+
+	if (client == NULL || client->sync.alarm != e->alarm
+			|| ! client->sync.waiting)
+		return;
+
+	if (value >= client->sync.value)
+		sync_done(client);
 }
 
 /*
@@ -1344,13 +2798,20 @@ client_t *create_client(xcb_window_t win)
 	/* XXX tiling: vertmax, fullscreen */
 	client->modal = false;
 	client->monitor = NULL;
+	client->monitem = NULL;
 	client->usercoord = false;
 	client->vertmaxed = false;
 	client->fullscreen = false;
 	client->take_focus = false;
 	client->use_delete = false;
 	client->hidden = false;
+	client->conceal = 0;
+	client->obscured = false;
+	client->stacked = 0;
+	client->tile_pending = false;
 	client->ignore_unmap = false;
+	client->configure_pending = false;
+	memset(&client->sync, 0, sizeof(client->sync));
 	client->ewmh_state_set = false;
 	client->killed = 0;
 
@@ -1417,9 +2878,11 @@ client_t *create_client(xcb_window_t win)
 
 	/* Finally create node with floating mode */
 	client->wsitem = wtree_new_client(client, floating);
+	update_limits(client);
 
 	/* Create frame and reparent */
 	attach_frame(client);
+	stack_insert(client);
 
 	/* Check if the window has _NET_WM_STATE_FULLSCREEN set
 	 * (XXX check for other states as well ?)
@@ -1528,10 +2991,22 @@ bool setup_keys()
 			// toggle modes and condition of current container/client
 			case KEY_TILING: case KEY_FLOATING:
 
-			// move to workspace
+			// move to workspace, or put on it too
 			case KEY_WS1: case KEY_WS2: case KEY_WS3: case KEY_WS4:
 			case KEY_WS5: case KEY_WS6: case KEY_WS7: case KEY_WS8:
 			case KEY_WS9: case KEY_WS10:
+				if (i >= KEY_WS1 && i <= KEY_WS10) {
+					xcb_grab_key(conn, 1, screen->root,
+							TAG_MODKEY,
+							keys[i].keycode,
+							XCB_GRAB_MODE_ASYNC,
+							XCB_GRAB_MODE_ASYNC);
+					xcb_grab_key(conn, 1, screen->root,
+							CONTAINER_MODKEY,
+							keys[i].keycode,
+							XCB_GRAB_MODE_ASYNC,
+							XCB_GRAB_MODE_ASYNC);
+				}
 
 				/* grab hjkl with extended modmask for resizing */
 				xcb_grab_key(conn, 1, screen->root,
@@ -1634,6 +3109,8 @@ bool setup_ewmh()
 		ewmh->_NET_REQUEST_FRAME_EXTENTS,   // message
 		ewmh->_NET_CLOSE_WINDOW,			// message
 		ewmh->_NET_MOVERESIZE_WINDOW,		// message
+		ewmh->_NET_WM_SYNC_REQUEST,			// message
+		ewmh->_NET_WM_SYNC_REQUEST_COUNTER,	// window
 		icccm.wm_change_state,				// message
 		icccm.wm_delete_window,				// message
 		icccm.wm_change_state,				// message
@@ -1646,7 +3123,7 @@ bool setup_ewmh()
 
 	xcb_ewmh_set_wm_name(ewmh, screen->root, 4, "wmwm");
 	xcb_ewmh_set_supporting_wm_check(ewmh, screen->root, screen->root);
-	xcb_ewmh_set_number_of_desktops(ewmh, screen_number, WORKSPACES);
+	ewmh_update_desktops();
 	xcb_ewmh_set_active_window(ewmh, screen_number, 0);
 
 	ewmh_update_client_list();
@@ -1707,8 +3184,8 @@ bool setup_screen()
 				PDEBUG("Looking for monitor on %d x %d.\n",
 						client->geometry.x,
 						client->geometry.y);
-				client->monitor = find_monitor_at(client->geometry.x,
-						client->geometry.y);
+				attach_monitor(client, find_monitor_at(client->geometry.x,
+						client->geometry.y));
 #if DEBUGMSG
 				if (client->monitor) {
 					PDEBUG("Found client on monitor %s.\n",
@@ -1731,10 +3208,10 @@ bool setup_screen()
 			 */
 			uint32_t ws = ewmh_get_workspace(children[i]);
 
-			if (ws < WORKSPACES) {
+			if (ws < WORKSPACES_MAX) {
 				set_to_workspace(client, ws);
-				/* If it's on our current workspace, show it, else hide it. */
-				if (ws == curws)
+				/* If it's on a shown workspace, show it, else hide it. */
+				if (ws_visible(ws))
 					show(client);
 				else
 					hide(client);
@@ -1764,27 +3241,71 @@ void ewmh_frame_extents(xcb_window_t win, int width)
 }
 
 /*
- * Fit frame window to shape of client window if necessary
+ * Publish as many desktops as there are keys for, or as are in use or
+ * shown, whatever is more.
+ */
+void ewmh_update_desktops()
+{
+	uint32_t count = WORKSPACES;
+
+	for (uint32_t word = (wslen + 31) / 32; word-- > 0; ) {
+		if (occupied[word]) {
+			const uint32_t last = word * 32 + 31 - __builtin_clz(occupied[word]);
+			if (last >= count)
+				count = last + 1;
+			break;
+		}
+	}
+	if (curws >= count)
+		count = curws + 1;
+	for (list_t *item = monlist; item; item = item->next) {
+		const monitor_t *mon = item->data;
+		if (mon->ws != WORKSPACE_NONE && mon->ws >= count)
+			count = mon->ws + 1;
+	}
+
+	if (count == desktops)
+		return;
+
+	desktops = count;
+	xcb_ewmh_set_number_of_desktops(ewmh, screen_number, count);
+}
+
+/*
+ * Does window win have a bounding shape?
  */
-void update_shape(client_t* client)
+bool is_shaped(xcb_window_t win)
 {
 	xcb_shape_query_extents_reply_t *extents;
 	xcb_generic_error_t* error;
 
-	extents = xcb_shape_query_extents_reply(conn, xcb_shape_query_extents(conn, client->id), &error);
+	extents = xcb_shape_query_extents_reply(conn, xcb_shape_query_extents(conn, win), &error);
 	if (error) {
-		PDEBUG("error querying shape extents for 0x%x\n", client->id);
+		PDEBUG("error querying shape extents for 0x%x\n", win);
 		print_x_error(error);
 		destroy(error);
-		return;
+		return false;
 	}
+	const bool shaped = extents->bounding_shaped;
+	destroy(extents);
+	return shaped;
+}
+
+/*
+ * Fit frame window to shape of client window if necessary
+ */
+void update_shape(client_t* client)
+{
+	/* Its own frame has its shape already */
+	if (client->frame == client->id)
+		return;
+
 	/* Do we have a bounding shape, e.g. shape for the frame */
-	if (extents->bounding_shaped) {
+	if (is_shaped(client->id)) {
 		PDEBUG("0x%x is shaped, shaping frame\n", client->id);
 		xcb_shape_combine(conn, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, XCB_SHAPE_SK_BOUNDING,
 				client->frame, 0, 0, client->id);
 	}
-	destroy(extents);
 }
 
 /*
@@ -1802,6 +3323,31 @@ int setup_shape()
 	}
 }
 
+/*
+ * Setup SYNC extension, needed for _NET_WM_SYNC_REQUEST
+ */
+int setup_sync()
+{
+	const xcb_query_extension_reply_t *extension;
+	xcb_sync_initialize_reply_t *reply;
+
+	extension = xcb_get_extension_data(conn, &xcb_sync_id);
+	if (!extension->present) {
+		printf("No SYNC extension.\n");
+		return -1;
+	}
+
+	reply = xcb_sync_initialize_reply(conn, xcb_sync_initialize(conn,
+				XCB_SYNC_MAJOR_VERSION, XCB_SYNC_MINOR_VERSION), NULL);
+	if (! reply) {
+		printf("Could not initialize SYNC extension.\n");
+		return -1;
+	}
+	destroy(reply);
+
+	return extension->first_event;
+}
+
 /*
  * Set up RANDR extension. Get the extension base and subscribe to
  * events.
@@ -1855,16 +3401,46 @@ void get_randr()
 	PDEBUG("Found %d outputs.\n", len);
 
 	/* Request information for all outputs. */
-	get_outputs(outputs, len, res->config_timestamp);
+	get_outputs(res, outputs, len, res->config_timestamp);
 
 	destroy(res);
 }
 
+/*
+ * Refresh rate of mode in mHz, 0 if the mode isn't in res.
+ */
+uint32_t mode_refresh(const xcb_randr_get_screen_resources_current_reply_t *res,
+		xcb_randr_mode_t mode)
+{
+	xcb_randr_mode_info_iterator_t iter;
+
+	iter = xcb_randr_get_screen_resources_current_modes_iterator(res);
+	for (; iter.rem; xcb_randr_mode_info_next(&iter)) {
+		const xcb_randr_mode_info_t *info = iter.data;
+		uint64_t vtotal = info->vtotal;
+
+		if (info->id != mode)
+			continue;
+
+		if (info->mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN)
+			vtotal *= 2;
+		if (info->mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE)
+			vtotal /= 2;
+
+		if (info->htotal == 0 || vtotal == 0)
+			return 0;
+
+		return (uint64_t)info->dot_clock * 1000 / (info->htotal * vtotal);
+	}
+	return 0;
+}
+
 /*
  * Walk through all the RANDR outputs (number of outputs == len) there
  * was at time timestamp.
  */
-void get_outputs(xcb_randr_output_t * outputs, int len,
+void get_outputs(const xcb_randr_get_screen_resources_current_reply_t *res,
+		xcb_randr_output_t * outputs, int len,
 		xcb_timestamp_t timestamp)
 {
 	char *name = NULL;
@@ -1941,9 +3517,13 @@ void get_outputs(xcb_randr_output_t * outputs, int len,
 			/* Do we know this monitor already? */
 			if (!(mon = find_monitor(outputs[i]))) {
 				PDEBUG("Monitor unknown, adding to list.\n");
-				add_monitor(outputs[i], name,
+				mon = add_monitor(outputs[i], name,
 						crtc->x, crtc->y,
 						crtc->width, crtc->height);
+				if (mon) {
+					mon->refresh = mode_refresh(res, crtc->mode);
+					assign_workspace(mon);
+				}
 			} else {
 				bool changed = false;
 				/*
@@ -1969,6 +3549,8 @@ void get_outputs(xcb_randr_output_t * outputs, int len,
 					changed = true;
 				}
 
+				mon->refresh = mode_refresh(res, crtc->mode);
+
 				if (changed) {
 					arrbymon(mon);
 				}
@@ -1977,43 +3559,10 @@ void get_outputs(xcb_randr_output_t * outputs, int len,
 		} else {
 			PDEBUG("Monitor not used at the moment.\n");
 			/*
-			 * Check if it was used before. If it was, do something.
+			 * Check if it was used before. If it was, forget it.
 			 */
-			if ((mon = find_monitor(outputs[i]))) {
-// XXX tiling
-#if 0
-				list_t *item;
-				client_t *client;
-
-				/* Check all windows on this monitor and move them to
-				 * the next or to the first monitor if there is no
-				 * next.
-				 *
-				 * FIXME: Use per monitor workspace list instead of
-				 * global window list.
-				 */
-				for (item = winlist; item; item = item->next) {
-					client = item->data;
-					if (client->monitor == mon) {
-						if (! (client->monitor->item->next)) {
-							if (! monlist) {
-								client->monitor = NULL;
-							} else {
-								client->monitor = monlist->data;
-							}
-						} else {
-							client->monitor =
-								client->monitor->item->next->data;
-						}
-
-						update_geometry(client, NULL);
-					}
-				} /* for */
-
-				/* It's not active anymore. Forget about it. */
-				del_monitor(mon);
-#endif
-			}
+			if ((mon = find_monitor(outputs[i])))
+				remove_monitor(mon);
 		}
 		destroy(name);
 		destroy(output);
@@ -2023,163 +3572,534 @@ void get_outputs(xcb_randr_output_t * outputs, int len,
 
 void arrbymon(monitor_t *monitor)
 {
-//	client_t *client;
-
 	if (monitor == NULL)
 		return;
 	PDEBUG("arrbymon\n");
-	/*
-	 * Go through all windows on this monitor. If they don't fit on
-	 * the new screen, move them around and resize them as necessary.
-	 */
-// TODO tiling
-#if 0
-	for (list_t *item = winlist; item; item = item->next) {
-		client = item->data;
-		if (client->monitor == monitor) {
+
+	layout_begin();
+
+	/* Only its own windows have to fit onto it again */
+	for (list_t *item = monitor->clients; item; item = item->next) {
+		client_t *client = item->data;
+		if (client->fullscreen || wtree_is_floating(client->wsitem))
 			update_geometry(client, NULL);
+	}
+
+	/* and its workspace is laid out to what the monitor is now */
+	if (monitor->ws != WORKSPACE_NONE)
+		place_workspace(monitor->ws, monitor);
+
+	layout_end();
+}
+
+monitor_t *find_monitor(xcb_randr_output_t id)
+{
+	monitor_t *mon;
+
+	for (list_t *item = monlist; item; item = item->next) {
+		mon = item->data;
+		if (id == mon->id) {
+			PDEBUG("find_monitor: Found it. Output ID: %u\n", mon->id);
+			return mon;
 		}
-	}							/* for */
-#endif
+	}
+
+	return NULL;
+}
+
+monitor_t *find_clones(xcb_randr_output_t id, int16_t x, int16_t y)
+{
+	monitor_t *clonemon;
+
+	for (list_t *item = monlist; item; item = item->next) {
+		clonemon = item->data;
+
+		PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
+				clonemon->name,
+				clonemon->x, clonemon->x + clonemon->width,
+				clonemon->y, clonemon->y + clonemon->height);
+
+		/* Check for same position. */
+		if (id != clonemon->id && clonemon->x == x && clonemon->y == y) {
+			return clonemon;
+		}
+	}
+
+	return NULL;
+}
+
+monitor_t *find_monitor_at(int16_t x, int16_t y)
+{
+	monitor_t* mon;
+
+	for (list_t* item = monlist; item; item = item->next) {
+		mon = item->data;
+		PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
+				mon->name,
+				mon->x, mon->x + mon->width, mon->y, mon->y + mon->height);
+
+		PDEBUG("Is %d,%d between them?\n", x, y);
+
+		if (x >= mon->x && x <= mon->x + mon->width
+				&& y >= mon->y && y <= mon->y + mon->height) {
+			PDEBUG("find_monitor_at: Found it. Output ID: %u, name %s\n",
+					mon->id, mon->name);
+			return mon;
+		}
+	}
+
+	return NULL;
+}
+
+void del_monitor(monitor_t *mon)
+{
+	PDEBUG("Deleting output %s.\n", mon->name);
+	destroy(mon->name);
+	list_erase(&monlist, NULL, mon->item);
+}
+
+monitor_t *add_monitor(xcb_randr_output_t id, char *name,
+		uint32_t x, uint32_t y, uint16_t width, uint16_t height)
+{
+	list_t *item;
+	monitor_t *mon;
+
+	if (! (item = list_add(&monlist))) {
+		perror("wmwm add_monitor");
+		return NULL;
+	}
+
+	if (! (mon = calloc(1, sizeof(monitor_t)))) {
+		perror("wmwm add_monitor");
+		return NULL;
+	}
+
+	item->data = mon;
+
+	if (name) {
+		mon->name = calloc(strlen(name) + 1, sizeof(char));
+		strcpy(mon->name, name);
+	} else {
+		mon->name = NULL;
+	}
+
+	mon->id = id;
+	mon->x = x;
+	mon->y = y;
+	mon->width = width;
+	mon->height = height;
+	mon->refresh = 0;
+	mon->ws = WORKSPACE_NONE;
+	mon->item = item;
+
+	return mon;
+}
+
+/* Monitor workspace ws is shown on, NULL if it's hidden or without RANDR. */
+monitor_t *ws_monitor(uint32_t ws)
+{
+	for (list_t *item = monlist; item; item = item->next) {
+		monitor_t *mon = item->data;
+		if (mon->ws == ws)
+			return mon;
+	}
+	return NULL;
+}
+
+/* Is workspace ws shown on any monitor? */
+bool ws_visible(uint32_t ws)
+{
+	return (ws == curws || ws_monitor(ws) != NULL);
+}
+
+/*
+ * Move client over to mon. A floating window keeps its place relative
+ * to the monitor, a fullscreen one fills the new one.
+ */
+void set_monitor(client_t *client, monitor_t *mon)
+{
+	xcb_rectangle_t from;
+	xcb_rectangle_t to;
+
+	if (client->monitor == mon)
+		return;
+
+	get_monitor_geometry(client->monitor, &from);
+	get_monitor_geometry(mon, &to);
+	attach_monitor(client, mon);
+
+	if (client->fullscreen) {
+		update_geometry(client, NULL);
+	} else if (wtree_is_floating(client->wsitem)) {
+		xcb_rectangle_t geo = client->geometry;
+		geo.x += to.x - from.x;
+		geo.y += to.y - from.y;
+		update_geometry(client, &geo);
+	}
+}
+
+/* Move client from the client list of its monitor to that of mon. */
+void attach_monitor(client_t *client, monitor_t *mon)
+{
+	if (client->monitor)
+		list_remove(&client->monitor->clients, client->monitem);
+	client->monitem = NULL;
+	client->monitor = NULL;
+
+	if (mon == NULL)
+		return;
+
+	if (! (client->monitem = list_add(&mon->clients))) {
+		perror("wmwm attach_monitor");
+		return;
+	}
+	client->monitem->data = client;
+	client->monitor = mon;
+}
+
+/*
+ * Client of a workspace being shown moves over, unless it's shown on
+ * another of its workspaces.
+ */
+static void place_client(client_t *client, void *arg)
+{
+	const struct view *view = arg;
+
+	if (client->ws != view->ws) {
+		if (ws_visible(client->ws))
+			return;
+		tag_view(client, view->ws);
+	}
+	set_monitor(client, view->mon);
+}
+
+/*
+ * Show workspace ws on mon (NULL for the whole screen). Its windows
+ * move over and its tiles are laid out if its space changed or if it
+ * was changed while hidden.
+ */
+void place_workspace(uint32_t ws, monitor_t *mon)
+{
+	wtree_t *root = ws_root(ws);
+	struct view view = { ws, mon, 0 };
+	xcb_rectangle_t rect;
+
+	/* Nothing there, it's made on the right monitor when used */
+	if (root == NULL)
+		return;
+
+	get_monitor_geometry(mon, &rect);
+
+	const xcb_rectangle_t old = wtree_screen_geo(root);
+
+	wtree_foreach_client(root, &place_client, &view);
+
+	if (old.x != rect.x || old.y != rect.y
+			|| old.width != rect.width || old.height != rect.height) {
+		wtree_set_screen_geo(root, rect);
+		wtree_mark_dirty(root);
+	}
+
+	if (wtree_dirty(root)) {
+		PDEBUG("workspace #%u has %u changes\n", ws, wtree_dirty(root));
+		relayout(ws);
+	}
+}
+
+/*
+ * Give the new monitor mon a workspace to show. The first one gets
+ * the current workspace, the others the first hidden one.
+ */
+void assign_workspace(monitor_t *mon)
+{
+	uint32_t ws;
+
+	if (curmon == NULL) {
+		curmon = mon;
+		mon->ws = curws;
+		place_workspace(curws, mon);
+		return;
+	}
+
+	for (ws = 0; ws < WORKSPACES_MAX && ws_visible(ws); ws++)
+		;
+	if (ws == WORKSPACES_MAX) {
+		PDEBUG("No workspace left for monitor %s.\n", mon->name);
+		return;
+	}
+
+	mon->ws = ws;
+
+	layout_begin();
+	place_workspace(ws, mon);
+	show_workspace(ws);
+	layout_end();
+
+	ewmh_update_desktops();
+}
+
+/*
+ * Output mon is gone. Exactly the clients that were on it move to
+ * another one. Its workspace is hidden, unless it was the last
+ * monitor, then the whole screen shows it.
+ */
+void remove_monitor(monitor_t *mon)
+{
+	const uint32_t ws = mon->ws;
+	const bool current = (mon == curmon);
+	monitor_t *to = NULL;
+
+	PDEBUG("Output %s is gone.\n", mon->name);
+
+	/* Any other monitor will do */
+	for (list_t *item = monlist; item && ! to; item = item->next) {
+		if (item->data != mon)
+			to = item->data;
+	}
+
+	if (current)
+		curmon = NULL;
+	mon->ws = WORKSPACE_NONE;
+
+	layout_begin();
+
+	if (ws != WORKSPACE_NONE && to)
+		hide_workspace(ws, view_tags() & ~TAG(ws));
+
+	/* set_monitor() takes each off the list */
+	while (mon->clients)
+		set_monitor(mon->clients->data, to);
+
+	del_monitor(mon);
+
+	if (ws != WORKSPACE_NONE && ! to)
+		place_workspace(ws, NULL);
+
+	layout_end();
+
+	if (current)
+		focus_monitor(to);
+	if (ws != WORKSPACE_NONE)
+		ws_update(ws);
+}
+
+/* Make mon and the workspace it shows current. */
+void focus_monitor(monitor_t *mon)
+{
+	if (mon == NULL || mon == curmon || mon->ws == WORKSPACE_NONE)
+		return;
+
+	PDEBUG("focus_monitor: %s with workspace #%u\n", mon->name, mon->ws);
+
+	unset_focus();
+
+	curmon = mon;
+	curws = mon->ws;
+	xcb_ewmh_set_current_desktop(ewmh, screen_number, curws);
 }
 
-monitor_t *find_monitor(xcb_randr_output_t id)
+static unsigned layer(const client_t *client)
 {
-	monitor_t *mon;
-
-	for (list_t *item = monlist; item; item = item->next) {
-		mon = item->data;
-		if (id == mon->id) {
-			PDEBUG("find_monitor: Found it. Output ID: %u\n", mon->id);
-			return mon;
-		}
-	}
+	if (client->fullscreen)
+		return LAYER_FULLSCREEN;
+	return wtree_is_floating(client->wsitem) ? LAYER_FLOATING : LAYER_TILED;
+}
 
-	return NULL;
+static unsigned item_layer(const list_t *item)
+{
+	return layer(item->data);
 }
 
-monitor_t *find_clones(xcb_randr_output_t id, int16_t x, int16_t y)
+/*
+ * Put client right below above in stacklist, on top if above is NULL.
+ * The server is told relative to a neighbor, nothing is sent if the
+ * order stays the same, unless force is set.
+ */
+static void stack_place(client_t *client, list_t *above, bool force)
 {
-	monitor_t *clonemon;
+	list_t *item = client->stackitem;
+	const client_t *sibling;
+	uint32_t values[2];
 
-	for (list_t *item = monlist; item; item = item->next) {
-		clonemon = item->data;
+	if (item->prev == above && ! force) {
+		++stats.raises_skipped;
+		return;
+	}
 
-		PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
-				clonemon->name,
-				clonemon->x, clonemon->x + clonemon->width,
-				clonemon->y, clonemon->y + clonemon->height);
+	list_move_after(&stacklist, above, item);
+	stack_dirty = true;
+	occlusion_dirty = true;
 
-		/* Check for same position. */
-		if (id != clonemon->id && clonemon->x == x && clonemon->y == y) {
-			return clonemon;
-		}
+	if (item->next) {
+		sibling = item->next->data;
+		values[1] = XCB_STACK_MODE_ABOVE;
+	} else if (item->prev) {
+		sibling = item->prev->data;
+		values[1] = XCB_STACK_MODE_BELOW;
+	} else {
+		/* the only one, we don't care about others */
+		return;
 	}
+	values[0] = sibling->frame;
 
-	return NULL;
+	const xcb_void_cookie_t cookie = xcb_configure_window(conn, client->frame,
+			XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE, values);
+	note_request(cookie);
+
+	/*
+	 * A window that is its own frame may be destroyed by its client
+	 * before we know, which fails the restack.
+	 */
+	if (client->frame == client->id || sibling->frame == sibling->id) {
+		restacks.sequence[restacks.next] = cookie.sequence;
+		restacks.window[restacks.next] = client->id;
+		restacks.next = (restacks.next + 1) % STACK_RETRIES;
+	}
 }
 
-monitor_t *find_monitor_at(int16_t x, int16_t y)
+/*
+ * Is e about a restack of stack_place() that failed? The window it
+ * was placed next to is gone, and so is its DestroyNotify, which
+ * came first. Place the window next to the one that is there now.
+ */
+bool stack_failed(const xcb_generic_error_t *e)
 {
-	monitor_t* mon;
+	if (e->major_code != XCB_CONFIGURE_WINDOW)
+		return false;
 
-	for (list_t* item = monlist; item; item = item->next) {
-		mon = item->data;
-		PDEBUG("Monitor %s: x, y: %d--%d, %d--%d.\n",
-				mon->name,
-				mon->x, mon->x + mon->width, mon->y, mon->y + mon->height);
+	for (unsigned i = 0; i < STACK_RETRIES; i++) {
+		if (restacks.window[i] == XCB_NONE
+				|| restacks.sequence[i] != e->full_sequence)
+			continue;
 
-		PDEBUG("Is %d,%d between them?\n", x, y);
+		client_t *client = find_client(restacks.window[i]);
+		restacks.window[i] = XCB_NONE;
 
-		if (x >= mon->x && x <= mon->x + mon->width
-				&& y >= mon->y && y <= mon->y + mon->height) {
-			PDEBUG("find_monitor_at: Found it. Output ID: %u, name %s\n",
-					mon->id, mon->name);
-			return mon;
-		}
+		PDEBUG("restack of 0x%x failed, again\n", client ? client->id : 0);
+		if (client && client->stackitem)
+			stack_place(client, client->stackitem->prev, true);
+		return true;
 	}
-
-	return NULL;
+	return false;
 }
 
-void del_monitor(monitor_t *mon)
+/* Window client goes right below to be on top of its layer, NULL for the top. */
+static list_t *stack_top_of(const client_t *client)
 {
-	PDEBUG("Deleting output %s.\n", mon->name);
-	destroy(mon->name);
-	list_erase(&monlist, NULL, mon->item);
+	const unsigned l = layer(client);
+	list_t *above = NULL;
+
+	for (list_t *item = stacklist; item; item = item->next) {
+		if (item == client->stackitem)
+			continue;
+		if (item_layer(item) <= l)
+			break;
+		above = item;
+	}
+	return above;
 }
 
-monitor_t *add_monitor(xcb_randr_output_t id, char *name,
-		uint32_t x, uint32_t y, uint16_t width, uint16_t height)
+/* Window client goes right below to be at the bottom of its layer. */
+static list_t *stack_bottom_of(const client_t *client)
 {
-	list_t *item;
-	monitor_t *mon;
+	const unsigned l = layer(client);
+	list_t *above = NULL;
 
-	if (! (item = list_add(&monlist))) {
-		perror("wmwm add_monitor");
-		return NULL;
+	for (list_t *item = stacklist; item; item = item->next) {
+		if (item == client->stackitem)
+			continue;
+		if (item_layer(item) < l)
+			break;
+		above = item;
 	}
+	return above;
+}
 
-	if (! (mon = calloc(1, sizeof(monitor_t)))) {
-		perror("wmwm add_monitor");
-		return NULL;
+/* New client goes on top of its layer. */
+void stack_insert(client_t *client)
+{
+	if (! (client->stackitem = list_add(&stacklist))) {
+		perror("wmwm stack_insert");
+		return;
 	}
+	client->stackitem->data = client;
 
-	item->data = mon;
+	/* The server doesn't know where it is in our order yet */
+	stack_place(client, stack_top_of(client), true);
+}
 
-	if (name) {
-		mon->name = calloc(strlen(name) + 1, sizeof(char));
-		strcpy(mon->name, name);
-	} else {
-		mon->name = NULL;
-	}
+void stack_remove(client_t *client)
+{
+	if (client->stackitem == NULL)
+		return;
+	list_remove(&stacklist, client->stackitem);
+	client->stackitem = NULL;
+	stack_dirty = true;
+}
 
-	mon->id = id;
-	mon->x = x;
-	mon->y = y;
-	mon->width = width;
-	mon->height = height;
-	mon->item = item;
+/* Number client->stacked from the bottom up, if stacklist changed. */
+void stack_number()
+{
+	uint32_t n = UINT32_MAX;
 
-	return mon;
+	if (! stack_dirty)
+		return;
+
+	for (list_t *item = stacklist; item; item = item->next)
+		((client_t*)item->data)->stacked = n--;
+	stack_dirty = false;
 }
 
+/*
+ * Client changed its layer, e.g. it's floating now. It goes on top
+ * of its new one, otherwise it stays where it is.
+ */
 void adjust_stacking(client_t *client)
 {
-	if (wtree_is_floating(client->wsitem) || client->fullscreen)
-		raise_client(client);
-	else
-		lower_client(client);
+	const list_t *item = client->stackitem;
+	const unsigned l = layer(client);
+
+	if (item == NULL)
+		return;
+
+	if ((item->prev && item_layer(item->prev) < l)
+			|| (item->next && item_layer(item->next) > l))
+		stack_place(client, stack_top_of(client), false);
 }
 
 void lower_client(client_t *client)
 {
-	uint32_t values[] = { XCB_STACK_MODE_BELOW };
 	assert(client != NULL);
 
-	xcb_configure_window(conn, client->frame,
-			XCB_CONFIG_WINDOW_STACK_MODE, values);
+	if (client->stackitem)
+		stack_place(client, stack_bottom_of(client), false);
 }
 
 void raise_client(client_t *client)
 {
-	uint32_t values[] = { XCB_STACK_MODE_ABOVE };
 	assert(client != NULL);
 
-	xcb_configure_window(conn, client->frame,
-			XCB_CONFIG_WINDOW_STACK_MODE, values);
+	if (client->stackitem)
+		stack_place(client, stack_top_of(client), false);
 }
 
 /*
- * Set window client to either top or bottom of stack depending on
+ * Set window client to either top or bottom of its layer depending on
  * where it is now.
  */
 void raise_or_lower_client(client_t *client)
 {
-	uint32_t values[] = { XCB_STACK_MODE_OPPOSITE };
 	assert(client != NULL);
 
-	xcb_configure_window(conn, client->frame, XCB_CONFIG_WINDOW_STACK_MODE, values);
+	const list_t *item = client->stackitem;
+
+	if (item == NULL)
+		return;
+
+	if (item->prev == NULL || item_layer(item->prev) > layer(client))
+		lower_client(client);
+	else
+		raise_client(client);
 }
 
 /* Mark window win as unfocused. */
@@ -2294,11 +4214,13 @@ client_t *find_clientp(xcb_drawable_t win)
 	if (client && (client->id == win || client->frame == win))
 		return client;
 
-	client = wtree_find_client(wslist[curws], &find_clientp_helper, &win);
+	client = wtree_find_client(ws_root(curws), &find_clientp_helper, &win);
 	if (client)
 		return client;
 
-	for (uint32_t i = 0; i < WORKSPACES; i++) {
+	/* Skip the empty ones */
+	for (uint32_t i = ws_next_occupied(0); i < wslen;
+			i = ws_next_occupied(i + 1)) {
 		if (i == curws) continue;
 
 		client = wtree_find_client(wslist[i], &find_clientp_helper, &win);
@@ -2327,11 +4249,13 @@ client_t *find_client(xcb_drawable_t win)
 	if (client && client->id == win)
 		return client;
 
-	client = wtree_find_client(wslist[curws], &find_client_helper, &win);
+	client = wtree_find_client(ws_root(curws), &find_client_helper, &win);
 	if (client)
 		return client;
 
-	for (uint32_t i = 0; i < WORKSPACES; i++) {
+	/* Skip the empty ones */
+	for (uint32_t i = ws_next_occupied(0); i < wslen;
+			i = ws_next_occupied(i + 1)) {
 		if (i == curws) continue;
 
 		client = wtree_find_client(wslist[i], &find_client_helper, &win);
@@ -2368,13 +4292,23 @@ void set_focus(client_t *client)
 	if (client == focuswin(curws))
 		return;
 
+	/* Focus moves over to another monitor, its workspace gets current */
+	if (client->ws != curws && client->ws != WORKSPACE_NONE)
+		focus_monitor(ws_monitor(client->ws));
+
+	/* An inactive tab is switched to first: one map, one unmap */
+	if (client->conceal & CONCEAL_TAB) {
+		wtree_set_active(client->wsitem);
+		relayout(client->ws);
+	}
+
 	/* set input focus (preferred) or
 	 * send WM_TAKE_FOCUS
 	 */
 	if (client->allow_focus) {
 		PDEBUG("xcb_set_input_focus: 0x%x\n", client->id);
-		xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
-				client->id, get_timestamp());
+		note_request(xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
+				client->id, get_timestamp()));
 	} else if (client->take_focus) {
 		send_client_message(client->id, icccm.wm_take_focus);
 	}
@@ -2420,10 +4354,8 @@ int start(char *program)
 			perror("setsid");
 			exit(1);
 		}
-		/* reset signals on the new process, allowing it to catch em */
-		signal(SIGCHLD, SIG_DFL);
-		signal(SIGINT, SIG_DFL);
-		signal(SIGTERM, SIG_DFL);
+		/* unblock signals on the new process, allowing it to catch em */
+		loop_unblock_signals();
 
 		if (execvp(program, argv) == -1) {
 			perror("execve");
@@ -2435,6 +4367,20 @@ int start(char *program)
 	return 0;
 }
 
+/*
+ * Queue a keyboard step for client. Steps of another client are
+ * applied first.
+ */
+static void queue_step(client_t *client)
+{
+	if (steps.client != NULL && steps.client != client)
+		apply_steps();
+
+	steps.client = client;
+	++steps.count;
+	++stats.steps;
+}
+
 /*
  * Resize window client in direction direction.
  */
@@ -2446,40 +4392,160 @@ void resize_step(client_t *client, step_direction_t direction)
 	if (! client)
 		   return;
 
-	xcb_rectangle_t geometry = client->geometry;
-
-	if (client->fullscreen || ! wtree_is_floating(client->wsitem)) {
-		/* Can't resize a fully maximized or tiling-window. */
+	if (client->fullscreen) {
+		/* Can't resize a fully maximized window. */
 		return;
 	}
 
-	raise_client(client);
-
 	if (client->hints.width_inc > 1)
 		step_x = client->hints.width_inc;
 
 	if (client->hints.height_inc > 1)
 		step_y = client->hints.height_inc;
 
+	queue_step(client);
+
 	switch (direction) {
 		case step_left:
-			geometry.width  -= step_x;
+			steps.dw -= step_x;
 			break;
 
 		case step_up:
-			geometry.height += step_y;
+			steps.dh += step_y;
 			break;
 
 		case step_down:
-			geometry.height -= step_y;
+			steps.dh -= step_y;
 			break;
 
 		case step_right:
-			geometry.width  += step_x;
+			steps.dw += step_x;
 			break;
 	}							/* switch direction */
+}
+
+/*
+ * Move one edge of tile node along tiling by delta, taking the space
+ * from or giving it to a sibling. With edge, it has to be the right
+ * or lower edge, the one the pointer holds.
+ */
+static void resize_tile_edge(client_t *client, tiling_t tiling, int delta,
+		bool edge)
+{
+	wtree_t *node = client->wsitem;
+	wtree_t *sibling = NULL;
+
+	/* Closest container split along tiling with a tile to trade with */
+	for (; wtree_is_tiling_type(node->parent); node = node->parent) {
+		if (wtree_parent_tiling(node) != tiling)
+			continue;
+		sibling = wtree_neighbor_tile(node);
+		if (sibling && (! edge || sibling->prev == node))
+			break;
+		sibling = NULL;
+	}
+	if (sibling == NULL)
+		return;
+
+	wtree_t *tiler = node->parent;
+	const xcb_rectangle_t rect = wtree_tgeo(tiler);
+	const int length = (tiling == TILING_VERTICAL) ? rect.width : rect.height;
+
+	if (length == 0)
+		return;
+
+	/* Pixels to weights, neither may get too small for borders and gaps */
+	const float sum = wtree_favor_sum(tiler);
+	const float least = (2 * (conf.borderwidth + conf.gapwidth) + MOVE_STEP)
+		* sum / length;
+	const float mine = wtree_favor(node);
+	const float theirs = wtree_favor(sibling);
+	float change = delta * sum / length;
+
+	if (mine + change < least)
+		change = least - mine;
+	if (theirs - change < least)
+		change = theirs - least;
+	if (change == 0 || mine + change < least)
+		return;
+
+	wtree_set_favor(node, mine + change);
+	wtree_set_favor(sibling, theirs - change);
+
+	relayout_tiles(client->ws, tiler);
+}
+
+/*
+ * Resize a tiled client by changing its weight and that of a sibling,
+ * the rest of the container keeps its size and only that container is
+ * laid out again.
+ */
+void resize_tile(client_t *client, int dw, int dh, bool edge)
+{
+	if (dw != 0)
+		resize_tile_edge(client, TILING_VERTICAL, dw, edge);
+	if (dh != 0)
+		resize_tile_edge(client, TILING_HORIZONTAL, dh, edge);
+}
+
+/*
+ * Move window win as a result of pointer motion to coordinates
+ * rel_x,rel_y.
+ */
+void mouse_move(client_t *client, int rel_x, int rel_y)
+{
+	xcb_rectangle_t geo = conf.outline ? outline.geometry : client->geometry;
+	geo.x = rel_x; geo.y = rel_y;
+
+	if (conf.outline)
+		outline_show(client, &geo);
+	else
+		update_geometry(client, &geo);
+}
+
+void mouse_resize(client_t *client, int rel_x, int rel_y)
+{
+	/* The lower right edge of a tile follows the pointer */
+	if (! wtree_is_floating(client->wsitem)) {
+		const xcb_rectangle_t *tile = &client->geometry;
+		resize_tile(client, rel_x - (tile->x + tile->width),
+				rel_y - (tile->y + tile->height), true);
+		return;
+	}
+
+	xcb_rectangle_t geo = conf.outline ? outline.geometry : client->geometry;
+
+	/* Don't resize to negative values */
+	if (rel_x > geo.x)
+		geo.width = rel_x - geo.x;
+	if (rel_y > geo.y)
+		geo.height = rel_y - geo.y;
+
+	if (conf.outline)
+		outline_show(client, &geo);
+	else
+		resize_synced(client, &geo);
+}
+
+/*
+ * Resize client to geometry. If the client supports _NET_WM_SYNC_REQUEST,
+ * wait for it to catch up with the last resize first and keep only
+ * the latest geometry until then.
+ */
+void resize_synced(client_t *client, const xcb_rectangle_t *geometry)
+{
+	if (client->sync.waiting) {
+		client->sync.geometry = *geometry;
+		client->sync.pending = true;
+		return;
+	}
+
+	/* Once the drag is over, nothing waits for the client anymore */
+	client->sync.request = (client->sync.counter != XCB_NONE && drag.active);
+	const bool changed = update_geometry(client, geometry);
+	client->sync.request = false;
 
-	if (! update_geometry(client, &geometry))
+	if (! changed)
 		return;
 
 	/* If this window was vertically maximized, remember that it isn't now. */
@@ -2487,98 +4553,262 @@ void resize_step(client_t *client, step_direction_t direction)
 		client->vertmaxed = false;
 		ewmh_update_state(client);
 	}
+}
 
-	/* Place pointer in center if the it is not over client anymore */
-	if (! pointer_over_client(client)) {
+void move_step(client_t *client, step_direction_t direction)
+{
+	if (! client)
+		return;
+
+	if (client->fullscreen || ! wtree_is_floating(client->wsitem)) {
+		/* We can't move a fully maximized window. */
+		return;
+	}
+
+	queue_step(client);
+
+	switch (direction) {
+		case step_left:
+			steps.dx -= MOVE_STEP;
+			break;
+
+		case step_down:
+			steps.dy += MOVE_STEP;
+			break;
+
+		case step_up:
+			steps.dy -= MOVE_STEP;
+			break;
+
+		case step_right:
+			steps.dx += MOVE_STEP;
+			break;
+	}							/* switch direction */
+}
+
+/* Move and resize the client of the queued steps in one go. */
+void apply_steps()
+{
+	client_t *client = steps.client;
+	const bool moved = (steps.dx != 0 || steps.dy != 0);
+	const bool resized = (steps.dw != 0 || steps.dh != 0);
+	int16_t start_x = 0;
+	int16_t start_y = 0;
+
+	if (client == NULL)
+		return;
+
+	/* Tiles only change their weight, nothing to preview */
+	if (! wtree_is_floating(client->wsitem)) {
+		const int dw = steps.dw;
+		const int dh = steps.dh;
+
+		memset(&steps, 0, sizeof(steps));
+		resize_tile(client, dw, dh, false);
+		return;
+	}
+
+	/* A preview continues where the last one stopped */
+	xcb_rectangle_t geo = (conf.outline && outline.client == client) ?
+		outline.geometry : client->geometry;
+	geo.x += steps.dx;
+	geo.y += steps.dy;
+	geo.width += steps.dw;
+	geo.height += steps.dh;
+
+	PDEBUG("apply_steps: %u steps for 0x%x\n", steps.count, client->id);
+	memset(&steps, 0, sizeof(steps));
+
+	/* Only show the outline, commit when the keys are left alone */
+	if (conf.outline) {
+		outline_show(client, &geo);
+		loop_timer_cancel(outline.commit);
+		outline.commit = loop_timer_add(OUTLINE_DELAY * 1000, 0,
+				outline_timeout, NULL);
+		return;
+	}
+
+	/* Save pointer position so we can warp pointer here later. */
+	if (moved && ! get_pointer(client->id, &start_x, &start_y))
+		return;
+
+	raise_client(client);
+
+	if (! update_geometry(client, &geo))
+		return;
+
+	++stats.steps_applied;
+
+	/* If this window was vertically maximized, remember that it isn't now. */
+	if (resized && client->vertmaxed) {
+		client->vertmaxed = false;
+		ewmh_update_state(client);
+	}
+
+	/*
+	 * If the pointer was inside the window to begin with, move
+	 * pointer back to where it was, relative to the window.
+	 * Otherwise place it in the center if a resize left it outside.
+	 */
+	if (moved && start_x > 0 - conf.borderwidth
+			&& start_x < client->geometry.width + conf.borderwidth
+			&& start_y > 0 - conf.borderwidth
+			&& start_y < client->geometry.height + conf.borderwidth) {
+		xcb_warp_pointer(conn, XCB_WINDOW_NONE, client->frame, 0, 0, 0, 0,
+				start_x, start_y);
+	} else if (resized && ! pointer_over_client(client)) {
 		xcb_warp_pointer(conn, XCB_WINDOW_NONE, client->frame, 0, 0, 0, 0,
 				client->geometry.width / 2, client->geometry.height / 2);
 	}
 }
 
-/*
- * Move window win as a result of pointer motion to coordinates
- * rel_x,rel_y.
- */
-void mouse_move(client_t *client, int rel_x, int rel_y)
+/* Create the GC and the windows outlines are drawn with. */
+void setup_outline()
 {
-	xcb_rectangle_t geo = client->geometry;
-	geo.x = rel_x; geo.y = rel_y;
-	update_geometry(client, &geo);
-}
+	const uint32_t values[] = {
+		XCB_GX_XOR,
+		screen->white_pixel ^ screen->black_pixel,
+		XCB_SUBWINDOW_MODE_INCLUDE_INFERIORS
+	};
+	/* we don't manage them */
+	const uint32_t attrs[] = { conf.focuscol, true };
 
-void mouse_resize(client_t *client, int rel_x, int rel_y)
-{
-	xcb_rectangle_t geo = client->geometry;
+	outline.gc = xcb_generate_id(conn);
+	xcb_create_gc(conn, outline.gc, screen->root,
+			XCB_GC_FUNCTION | XCB_GC_FOREGROUND | XCB_GC_SUBWINDOW_MODE,
+			values);
 
-	/* Don't resize to negative values */
-	if (rel_x > geo.x)
-		geo.width = rel_x - geo.x;
-	if (rel_y > geo.y)
-		geo.height = rel_y - geo.y;
+	for (int i = 0; i < 4; i++) {
+		outline.edges[i] = xcb_generate_id(conn);
+		xcb_create_window(conn, XCB_COPY_FROM_PARENT, outline.edges[i],
+				screen->root, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+				XCB_COPY_FROM_PARENT,
+				XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT, attrs);
+	}
+}
 
-	if (! update_geometry(client, &geo))
-		return; // nothing changed
+/* Put the outline windows around the outline, above everything. */
+static void outline_place()
+{
+	const int border = outline.client->fullscreen ? 0 : conf.borderwidth;
+	const xcb_rectangle_t geo = outline.geometry;
+	const int width = geo.width + border * 2;
+	const int height = geo.height + border * 2;
+	const int32_t edges[4][4] = {
+		{ geo.x, geo.y, width, 1 },					// top
+		{ geo.x, geo.y + height - 1, width, 1 },	// bottom
+		{ geo.x, geo.y, 1, height },				// left
+		{ geo.x + width - 1, geo.y, 1, height }		// right
+	};
 
-	/* If this window was vertically maximized, remember that it isn't now. */
-	if (client->vertmaxed) {
-		client->vertmaxed = false;
-		ewmh_update_state(client);
+	for (int i = 0; i < 4; i++) {
+		const uint32_t values[] = {
+			edges[i][0], edges[i][1], edges[i][2], edges[i][3],
+			XCB_STACK_MODE_ABOVE
+		};
+		xcb_configure_window(conn, outline.edges[i],
+				XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y
+				| XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT
+				| XCB_CONFIG_WINDOW_STACK_MODE, values);
+		xcb_map_window(conn, outline.edges[i]);
 	}
 }
 
-void move_step(client_t *client, step_direction_t direction)
+/* Draw the outline, drawing it again erases it. */
+static void outline_draw()
 {
-	int16_t start_x;
-	int16_t start_y;
+	const int border = outline.client->fullscreen ? 0 : conf.borderwidth;
+	xcb_rectangle_t rect = outline.geometry;
 
-	if (! client)
-		return;
+	rect.width += border * 2 - 1;
+	rect.height += border * 2 - 1;
+	xcb_poly_rectangle(conn, screen->root, outline.gc, 1, &rect);
+}
 
-	xcb_rectangle_t geo = client->geometry;
+/*
+ * Show an outline of geometry for client instead of changing it.
+ * An outline of another client is committed first.
+ */
+void outline_show(client_t *client, const xcb_rectangle_t *geometry)
+{
+	if (outline.client != client)
+		outline_commit();
+
+	/* Nobody may draw below our XOR while the pointer drags it */
+	if (outline.client == NULL) {
+		if (! is_mode(mode_nothing)) {
+			xcb_grab_server(conn);
+			outline.grabbed = true;
+		}
+		outline.client = client;
+	}
 
-	if (client->fullscreen || ! wtree_is_floating(client->wsitem)) {
-		/* We can't move a fully maximized window. */
-		return;
+	if (! outline.grabbed) {
+		outline.geometry = *geometry;
+		outline_place();
+	} else {
+		if (outline.drawn)
+			outline_draw();
+		outline.geometry = *geometry;
+		outline_draw();
 	}
+	outline.drawn = true;
+}
 
-	/* Save pointer position so we can warp pointer here later. */
-	if (! get_pointer(client->id, &start_x, &start_y)) {
+/* Remove the outline without touching its client. */
+void outline_hide()
+{
+	if (outline.client == NULL)
 		return;
+
+	if (outline.drawn && outline.grabbed) {
+		outline_draw();
+	} else if (outline.drawn) {
+		for (int i = 0; i < 4; i++)
+			xcb_unmap_window(conn, outline.edges[i]);
 	}
 
-	raise_client(client);
+	loop_timer_cancel(outline.commit);
+	outline.commit = 0;
+	outline.drawn = false;
+	outline.client = NULL;
 
-	switch (direction) {
-		case step_left:
-			geo.x -= MOVE_STEP;
-			break;
+	if (outline.grabbed) {
+		xcb_ungrab_server(conn);
+		outline.grabbed = false;
+	}
+}
 
-		case step_down:
-			geo.y += MOVE_STEP;
-			break;
+/* Keys were left alone long enough. */
+void outline_timeout(void *arg)
+{
+	(void)arg;
+	outline.commit = 0;
+	outline_commit();
+}
 
-		case step_up:
-			geo.y -= MOVE_STEP;
-			break;
+/* Remove the outline and give its client the outlined geometry. */
+void outline_commit()
+{
+	client_t *client = outline.client;
+	const xcb_rectangle_t geo = outline.geometry;
 
-		case step_right:
-			geo.x += MOVE_STEP;
-			break;
-	}							/* switch direction */
+	if (client == NULL)
+		return;
+
+	outline_hide();
+	raise_client(client);
+
+	const bool resized = (geo.width != client->geometry.width
+			|| geo.height != client->geometry.height);
 
 	if (! update_geometry(client, &geo))
 		return;
 
-	/*
-	 * If the pointer was inside the window to begin with, move
-	 * pointer back to where it was, relative to the window.
-	 */
-	if (start_x > 0 - conf.borderwidth
-			&& start_x < client->geometry.width + conf.borderwidth
-			&& start_y > 0 - conf.borderwidth
-			&& start_y < client->geometry.height + conf.borderwidth) {
-		xcb_warp_pointer(conn, XCB_WINDOW_NONE, client->frame, 0, 0, 0, 0,
-				start_x, start_y);
+	/* If this window was vertically maximized, remember that it isn't now. */
+	if (resized && client->vertmaxed) {
+		client->vertmaxed = false;
+		ewmh_update_state(client);
 	}
 }
 
@@ -2604,7 +4834,7 @@ void set_borders(xcb_drawable_t win, int width)
 	PDEBUG("Setting borders (%d) to 0x%x\n", width, win);
 	values[0] = width;
 
-	xcb_configure_window(conn, win, mask, &values[0]);
+	note_request(xcb_configure_window(conn, win, mask, &values[0]));
 }
 
 void unmax(client_t *client)
@@ -2619,10 +4849,11 @@ void unmax(client_t *client)
 
 	/* Restore geometry. */
 	client->fullscreen = client->vertmaxed = false;
+	occlusion_dirty = true;
 	if (wtree_is_floating(client->wsitem))
 		update_geometry(client, &(client->geometry_last));
 	else
-		update_clues(wslist[client->ws], screen_rect());
+		relayout(client->ws);
 
 	set_borders(client->frame, conf.borderwidth);
 	ewmh_frame_extents(client->id, conf.borderwidth);
@@ -2658,6 +4889,7 @@ void toggle_fullscreen(client_t *client)
 	PDEBUG("<> Client unmaximized, maximizing!\n");
 
 	client->fullscreen = true;
+	occlusion_dirty = true;
 
 	client->geometry_last = client->geometry;
 
@@ -2713,7 +4945,8 @@ void toggle_vertical(client_t *client)
 void set_default_events(client_t *client)
 {
 	const uint32_t	mask = XCB_CW_EVENT_MASK;
-	const uint32_t	values[] = { DEFAULT_FRAME_EVENTS };
+	const uint32_t	values[] = { client->frame == client->id
+		? DIRECT_WINDOW_EVENTS : DEFAULT_FRAME_EVENTS };
 	xcb_change_window_attributes(conn, client->frame, mask, values);
 }
 
@@ -2721,7 +4954,8 @@ void set_default_events(client_t *client)
 void set_hidden_events(client_t *client)
 {
 	const uint32_t	mask = XCB_CW_EVENT_MASK;
-	const uint32_t	values[] = { HIDDEN_FRAME_EVENTS };
+	const uint32_t	values[] = { client->frame == client->id
+		? DEFAULT_WINDOW_EVENTS : HIDDEN_FRAME_EVENTS };
 	xcb_change_window_attributes(conn, client->frame, mask, values);
 }
 
@@ -2730,9 +4964,11 @@ void show(client_t *client)
 {
 	uint32_t data[] = { XCB_ICCCM_WM_STATE_NORMAL, XCB_NONE };
 
-	/* Map window and declare normal */
-	xcb_map_window(conn, client->id);
-	xcb_map_window(conn, client->frame);
+	/* Map window and declare normal, a concealed frame stays unmapped */
+	if (client->frame != client->id)
+		note_request(xcb_map_window(conn, client->id));
+	if (! client->conceal)
+		note_request(xcb_map_window(conn, client->frame));
 	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
 			icccm.wm_state, icccm.wm_state, 32, 2, data);
 
@@ -2740,6 +4976,7 @@ void show(client_t *client)
 	ewmh_update_state(client);
 
 	adjust_stacking(client);
+	occlusion_dirty = true;
 }
 
 /* Send window into iconic mode and hide */
@@ -2751,20 +4988,29 @@ void hide(client_t *client)
 	 * Unmap window and declare iconic.
 	 * Set ignore_unmap not to remove the client.
 	 */
-	client->ignore_unmap = true;
+	if (client->frame == client->id) {
+		/* Its own frame, concealed it's unmapped already */
+		if (! client->conceal) {
+			client->ignore_unmap = true;
+			note_request(xcb_unmap_window(conn, client->id));
+		}
+	} else {
+		client->ignore_unmap = true;
 
-	/* ICCCM 4.1.4
-	 * Reparenting window managers must unmap the client's window
-	 * when it is in the Iconic state, even if an ancestor window
-	 * being unmapped renders the client's window unviewable.
-	 */
-	xcb_unmap_window(conn, client->frame);
-	xcb_unmap_window(conn, client->id);
+		/* ICCCM 4.1.4
+		 * Reparenting window managers must unmap the client's window
+		 * when it is in the Iconic state, even if an ancestor window
+		 * being unmapped renders the client's window unviewable.
+		 */
+		note_request(xcb_unmap_window(conn, client->frame));
+		note_request(xcb_unmap_window(conn, client->id));
+	}
 	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->id,
 			icccm.wm_state, icccm.wm_state, 32, 2, data);
 
 	client->hidden = true;
 	ewmh_update_state(client);
+	occlusion_dirty = true;
 }
 
 /* Forget everything about client client. */
@@ -2775,14 +5021,28 @@ void erase_client(client_t *client)
 	xcb_generic_error_t *error = NULL;
 	uint32_t cws = client->ws;
 
-	if (client->frame != XCB_WINDOW_NONE) {
+	if (steps.client == client)
+		memset(&steps, 0, sizeof(steps));
+	stack_remove(client);
+
+	sync_free(client);
+	if (outline.client == client)
+		outline_hide();
+	if (dwell.client == client)
+		dwell_cancel();
+
+	/* Whatever is below the pointer now, it didn't move */
+	layout_begin();
+
+	if (client->frame != XCB_WINDOW_NONE && client->frame != client->id) {
 		error = xcb_request_check(conn,
 				xcb_reparent_window_checked(conn, client->id, screen->root, 0, 0));
-		xcb_destroy_window(conn, client->frame);
+		frame_put(client->frame);
 	}
 
 	/* remove from all workspaces */
 	remove_from_workspace(client);
+	attach_monitor(client, NULL);
 
 	/* check if the window is already gone */
 	if (! error || error->error_code != XCB_WINDOW)
@@ -2794,44 +5054,144 @@ void erase_client(client_t *client)
 	destroy(client);
 	ewmh_update_client_list();
 
-	update_clues(wslist[cws], screen_rect());
-	wtree_print_tree(wslist[cws]);
+	relayout(cws);
+	layout_end();
+	wtree_print_tree(ws_root(cws));
 }
 
 /*
- * Reparent window
+ * Create a new frame window at geo, it's unmapped.
  *
- * also install listening-events to parent and children
- * this does not check if there is already a parent
+ * The client covers all of it, so it has no background the server
+ * would paint over the client's contents on each resize. What's left
+ * of the contents stays in the top left corner.
  */
-void attach_frame(client_t *client)
+xcb_window_t frame_create(const xcb_rectangle_t *geo, uint16_t border)
 {
 	/* mask and values for frame window, the order matters */
-	uint32_t mask =
-		XCB_CW_BACK_PIXEL
+	const uint32_t mask =
+		XCB_CW_BACK_PIXMAP
 		| XCB_CW_BORDER_PIXEL
+		| XCB_CW_BIT_GRAVITY
 		| XCB_CW_OVERRIDE_REDIRECT
 		| XCB_CW_EVENT_MASK;
 
-	uint32_t values[4] = {
-		0ul,
+	const uint32_t values[5] = {
+		XCB_BACK_PIXMAP_NONE,
 		conf.unfocuscol,
+		XCB_GRAVITY_NORTH_WEST,
 		1,
 		HIDDEN_FRAME_EVENTS
 	};
 
-	const xcb_rectangle_t *geo = &(client->geometry);
-
-	/* Create new frame window */
-	client->frame = xcb_generate_id(conn);
-	xcb_create_window(conn, screen->root_depth, client->frame,
+	xcb_window_t frame = xcb_generate_id(conn);
+	xcb_create_window(conn, screen->root_depth, frame,
 			screen->root,
 			geo->x, geo->y,
 			geo->width, geo->height,
-			client->fullscreen ? 0 : conf.borderwidth,
+			border,
 			XCB_WINDOW_CLASS_INPUT_OUTPUT,
 			XCB_COPY_FROM_PARENT,
 			mask, values);
+	return frame;
+}
+
+/* Get a frame window at geo, from the pool if there is one. */
+xcb_window_t frame_get(const xcb_rectangle_t *geo, uint16_t border)
+{
+	if (framepool.len == 0) {
+		++stats.frame_misses;
+		return frame_create(geo, border);
+	}
+	++stats.frame_hits;
+
+	const xcb_window_t frame = framepool.frames[--framepool.len];
+	const uint32_t values[5] = {
+		geo->x, geo->y, geo->width, geo->height, border
+	};
+	const uint32_t events[1] = { HIDDEN_FRAME_EVENTS };
+
+	xcb_configure_window(conn, frame,
+			XCB_CONFIG_WINDOW_X
+			| XCB_CONFIG_WINDOW_Y
+			| XCB_CONFIG_WINDOW_WIDTH
+			| XCB_CONFIG_WINDOW_HEIGHT
+			| XCB_CONFIG_WINDOW_BORDER_WIDTH,
+			values);
+	xcb_change_window_attributes(conn, frame, XCB_CW_EVENT_MASK, events);
+	return frame;
+}
+
+/*
+ * Frame isn't used anymore, its client was reparented away. Keep it
+ * for the next one, as good as new, or destroy it if the pool is full.
+ */
+void frame_put(xcb_window_t frame)
+{
+	if (framepool.len == FRAME_POOL) {
+		xcb_destroy_window(conn, frame);
+		return;
+	}
+
+	/* the order matters */
+	const uint32_t values[2] = {
+		conf.unfocuscol,
+		XCB_EVENT_MASK_NO_EVENT
+	};
+
+	xcb_change_window_attributes(conn, frame,
+			XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK, values);
+	xcb_unmap_window(conn, frame);
+	if (shapebase != -1)
+		xcb_shape_mask(conn, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING,
+				frame, 0, 0, XCB_NONE);
+
+	framepool.frames[framepool.len++] = frame;
+}
+
+/* Create the frames of the pool ahead, when we frame every window. */
+void setup_framepool()
+{
+	const xcb_rectangle_t geo = { 0, 0, 1, 1 };
+
+	if (! conf.reparent)
+		return;
+
+	while (framepool.len < FRAME_POOL) {
+		framepool.frames[framepool.len] = frame_create(&geo, 0);
+		frame_put(framepool.frames[framepool.len]);
+	}
+}
+
+/*
+ * Reparent window
+ *
+ * also install listening-events to parent and children
+ * this does not check if there is already a parent
+ */
+void attach_frame(client_t *client)
+{
+	uint32_t mask;
+	uint32_t values[1];
+
+	const xcb_rectangle_t *geo = &(client->geometry);
+
+	/*
+	 * Not reparenting, the window is its own frame and gets the
+	 * border. The border of a shaped one wouldn't follow its shape.
+	 */
+	if (! conf.reparent && ! (shapebase != -1 && is_shaped(client->id))) {
+		PDEBUG("0x%x is its own frame\n", client->id);
+		client->frame = client->id;
+
+		mask = XCB_CW_EVENT_MASK;
+		values[0] = DEFAULT_WINDOW_EVENTS;
+		xcb_change_window_attributes(conn, client->id, mask, values);
+		return;
+	}
+
+	/* Get a frame window */
+	client->frame = frame_get(geo, client->fullscreen ? 0 : conf.borderwidth);
 
 	/* set client window borderless */
 	set_borders(client->id, 0);
@@ -2932,6 +5292,8 @@ void warp_focuswin(step_direction_t direction)
  */
 void send_configuration(client_t *client)
 {
+	client->configure_pending = false;
+
 	xcb_configure_notify_event_t ev = {
 		.response_type = XCB_CONFIGURE_NOTIFY,
 		.sequence = 0,
@@ -2945,8 +5307,8 @@ void send_configuration(client_t *client)
 		.border_width = 0,
 		.override_redirect = 0
 	};
-	xcb_send_event(conn, false, client->id,
-			XCB_EVENT_MASK_NO_EVENT, (char *) &ev);
+	note_request(xcb_send_event(conn, false, client->id,
+			XCB_EVENT_MASK_NO_EVENT, (char *) &ev));
 }
 
 void send_client_message(xcb_window_t window, xcb_atom_t atom)
@@ -2961,8 +5323,8 @@ void send_client_message(xcb_window_t window, xcb_atom_t atom)
 		.type = icccm.wm_protocols, // ewmh.WM_PROTOCOLS available
 		.data.data32 = {atom, get_timestamp()}
 	};
-	xcb_send_event(conn, false, window,
-			XCB_EVENT_MASK_NO_EVENT, (char *) &ev);
+	note_request(xcb_send_event(conn, false, window,
+			XCB_EVENT_MASK_NO_EVENT, (char *) &ev));
 }
 
 void delete_win(client_t* client)
@@ -2982,169 +5344,428 @@ void delete_win(client_t* client)
 	}
 }
 
-/* Move focus window to previous screen */
-void prev_screen()
+/*
+ * Move focus window over to the workspace of the monitor in item.
+ * Without a focus window, just go there.
+ */
+static void send_to_monitor(list_t *item)
+{
+	client_t *client = focuswin(curws);
+
+	if (! item || ((monitor_t*)item->data)->ws == WORKSPACE_NONE)
+		return;
+
+	const uint32_t ws = ((monitor_t*)item->data)->ws;
+
+	if (! client || client->fullscreen) {
+		change_workspace(ws);
+		return;
+	}
+
+	move_to_workspace(client, ws);
+	set_focus(client);
+	adjust_stacking(client);
+
+	xcb_warp_pointer(conn, XCB_WINDOW_NONE, client->frame,
+			0, 0, 0, 0, 0, 0);
+}
+
+/* Move focus window to previous screen */
+void prev_screen()
+{
+	if (curmon)
+		send_to_monitor(curmon->item->prev);
+}
+
+/* Move focus window to next screen */
+void next_screen()
+{
+	if (curmon)
+		send_to_monitor(curmon->item->next);
+}
+
+/* Helper function to configure a window. */
+void configure_win(xcb_window_t win, uint16_t mask, winconf_t wc)
+{
+	uint32_t values[7];
+	int i = 0;
+
+	uint16_t new_mask = 0;
+
+	if (mask & XCB_CONFIG_WINDOW_X) {
+		new_mask |= XCB_CONFIG_WINDOW_X;
+		values[i++] = wc.x;
+	}
+
+	if (mask & XCB_CONFIG_WINDOW_Y) {
+		new_mask |= XCB_CONFIG_WINDOW_Y;
+		values[i++] = wc.y;
+	}
+
+	if (mask & XCB_CONFIG_WINDOW_WIDTH) {
+		new_mask |= XCB_CONFIG_WINDOW_WIDTH;
+		values[i++] = wc.width;
+	}
+
+	if (mask & XCB_CONFIG_WINDOW_HEIGHT) {
+		new_mask |= XCB_CONFIG_WINDOW_HEIGHT;
+		values[i++] = wc.height;
+	}
+
+	if (mask & XCB_CONFIG_WINDOW_SIBLING) {
+		new_mask |= XCB_CONFIG_WINDOW_SIBLING;
+		values[i++] = wc.sibling;
+	}
+
+	if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+		new_mask |= XCB_CONFIG_WINDOW_STACK_MODE;
+		values[i++] = wc.stackmode;
+	}
+
+	if (i > 0)
+		note_request(xcb_configure_window(conn, win, new_mask, values));
+}
+
+/* Dispatch one X event to its handler */
+static void handle_event(xcb_generic_event_t *ev)
+{
+	const uint8_t response_type = XCB_EVENT_RESPONSE_TYPE(ev);
+	PDEBUG("  | %s (%d, handled: %d)\n",
+			xcb_event_get_label(response_type),
+			response_type,
+			handler[response_type] ? 1 : 0);
+
+	/* Everything but keys sees the geometry of queued steps */
+	if (response_type != XCB_KEY_PRESS && response_type != XCB_KEY_RELEASE)
+		apply_steps();
+
+	/* check for RANDR, SHAPE */
+	if (randrbase != -1 && response_type ==
+				(randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY)) {
+		PDEBUG("RANDR screen change notify. Checking outputs.\n");
+		get_randr();
+	} else if (shapebase != -1
+			&& response_type == shapebase + XCB_SHAPE_NOTIFY) {
+		xcb_shape_notify_event_t *sev =
+			(xcb_shape_notify_event_t*) ev;
+
+		set_timestamp(sev->server_time);
+
+		PDEBUG("SHAPE notify (win: 0x%x, shaped: %d)\n",
+				sev->affected_window, sev->shaped);
+		if (sev->shaped) {
+			client_t* client = find_client(sev->affected_window);
+			if (client)
+				update_shape(client);
+		}
+	} else if (syncbase != -1
+			&& response_type == syncbase + XCB_SYNC_ALARM_NOTIFY) {
+		handle_sync_alarm((xcb_sync_alarm_notify_event_t*) ev);
+	} else if (handler[response_type]) {
+		handler[response_type](ev);
+	}
+}
+
+/*
+ * Sequence number of the next request.
+ *
+ * xcb doesn't tell us about the last request it queued, a NoOperation
+ * is the cheapest request that does.
+ */
+static unsigned int request_sequence()
+{
+	return last_seq = xcb_no_operation(conn).sequence;
+}
+
+/*
+ * Remember the sequence of a request we send anyway, for counting
+ * the requests since the last flush without sending any more.
+ */
+void note_request(xcb_void_cookie_t cookie)
+{
+	last_seq = cookie.sequence;
+}
+
+/* Flush, reason is the stats counter to account the flush to. */
+static void flush(uint64_t *reason)
+{
+	const uint64_t now = loop_now();
+	const uint64_t interval = now - last_flush;
+
+	xcb_flush(conn);
+
+	++stats.flushes;
+	++(*reason);
+	stats.flush_interval += interval;
+	if (interval > stats.flush_interval_max)
+		stats.flush_interval_max = interval;
+
+	last_flush = now;
+	flush_seq = last_seq;
+}
+
+/*
+ * Flush in the middle of a batch, if the batch took longer than
+ * FLUSH_BUDGET since the last flush or FLUSH_REQUESTS are waiting
+ * to be sent. Requests are counted up to the last one noted by
+ * note_request(), the budget catches any sent after it.
+ */
+static void flush_policy()
+{
+	if (loop_now() - last_flush >= FLUSH_BUDGET)
+		flush(&stats.flush_budget);
+	else if (last_seq - flush_seq >= FLUSH_REQUESTS)
+		flush(&stats.flush_requests);
+}
+
+/* Is this one of the user's input events we handle first? */
+static bool is_input_event(uint8_t response_type)
+{
+	switch (response_type) {
+		case XCB_KEY_PRESS:
+		case XCB_KEY_RELEASE:
+		case XCB_BUTTON_PRESS:
+		case XCB_BUTTON_RELEASE:
+		case XCB_MOTION_NOTIFY:
+		case XCB_ENTER_NOTIFY:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Does the event change what every later input event means,
+ * e.g. the keyboard mapping or the screen layout?
+ */
+static bool is_barrier_event(uint8_t response_type)
+{
+	return (response_type == XCB_MAPPING_NOTIFY
+			|| (randrbase != -1 && response_type ==
+				randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY));
+}
+
+/* Window a housekeeping event is about, XCB_WINDOW_NONE if none */
+static xcb_window_t event_window(xcb_generic_event_t *ev)
+{
+	switch (XCB_EVENT_RESPONSE_TYPE(ev)) {
+		case XCB_MAP_REQUEST:
+			return ((xcb_map_request_event_t*)ev)->window;
+		case XCB_CONFIGURE_REQUEST:
+			return ((xcb_configure_request_event_t*)ev)->window;
+		case XCB_CONFIGURE_NOTIFY:
+			return ((xcb_configure_notify_event_t*)ev)->window;
+		case XCB_CIRCULATE_REQUEST:
+			return ((xcb_circulate_request_event_t*)ev)->window;
+		case XCB_UNMAP_NOTIFY:
+			return ((xcb_unmap_notify_event_t*)ev)->window;
+		case XCB_DESTROY_NOTIFY:
+			return ((xcb_destroy_notify_event_t*)ev)->window;
+		case XCB_PROPERTY_NOTIFY:
+			return ((xcb_property_notify_event_t*)ev)->window;
+		case XCB_CLIENT_MESSAGE:
+			return ((xcb_client_message_event_t*)ev)->window;
+		case XCB_COLORMAP_NOTIFY:
+			return ((xcb_colormap_notify_event_t*)ev)->window;
+		case XCB_FOCUS_IN:
+			return ((xcb_focus_in_event_t*)ev)->event;
+		default:
+			return XCB_WINDOW_NONE;
+	}
+}
+
+/* Client an input event acts on */
+static client_t *input_client(xcb_generic_event_t *ev)
+{
+	switch (XCB_EVENT_RESPONSE_TYPE(ev)) {
+		case XCB_ENTER_NOTIFY:
+			return find_clientp(((xcb_enter_notify_event_t*)ev)->event);
+		case XCB_BUTTON_PRESS:
+		case XCB_BUTTON_RELEASE: {
+			xcb_button_press_event_t *e = (xcb_button_press_event_t*)ev;
+			/* on the root window, it's about the child below */
+			return find_clientp(e->event == screen->root ? e->child : e->event);
+		}
+		case XCB_MOTION_NOTIFY: {
+			xcb_motion_notify_event_t *e = (xcb_motion_notify_event_t*)ev;
+			return find_clientp(e->event == screen->root ? e->child : e->event);
+		}
+		default:
+			/* keys act on the focused window */
+			return focuswin(curws);
+	}
+}
+
+/* Is client's window or frame in the list of windows? */
+static bool client_in(const xcb_window_t *windows, unsigned len,
+		client_t *client)
 {
-	list_t *item;
-
-	if (! focuswin(curws) || ! focuswin(curws)->monitor)
-		return;
-
-	item = focuswin(curws)->monitor->item->prev;
-
-	if (! item)
-		return;
-
-	focuswin(curws)->monitor = item->data;
-
-	adjust_stacking(focuswin(curws));
-	update_geometry(focuswin(curws), NULL);
+	if (client == NULL)
+		return false;
 
-	xcb_warp_pointer(conn, XCB_WINDOW_NONE, focuswin(curws)->frame,
-			0, 0, 0, 0, 0, 0);
+	for (unsigned i = 0; i < len; i++) {
+		if (windows[i] == client->id || windows[i] == client->frame)
+			return true;
+	}
+	return false;
 }
 
-/* Move focus window to next screen */
-void next_screen()
+/*
+ * Run a batch of events in two levels.
+ *
+ * First the user's input events, keys, buttons, motion and enter
+ * events, followed by a flush, so they don't wait behind the
+ * housekeeping of other clients. Then everything else in the order
+ * it came in.
+ *
+ * An input event stays in order if an earlier event of the batch is
+ * about the window it acts on, or if it's behind a barrier event.
+ */
+static void run_batch(xcb_generic_event_t **batch, unsigned len)
 {
-	list_t *item;
+	xcb_window_t blocked[EVENT_BATCH];	/* windows of pending events */
+	unsigned nblocked = 0;
+	bool barrier = false;
+	bool input = false;
 
-	if (! focuswin(curws) || ! focuswin(curws)->monitor)
+	if (len == 0)
 		return;
 
-	item = focuswin(curws)->monitor->item->next;
+	++stats.batches;
+	stats.batch_events += len;
+	if (len > stats.batch_max)
+		stats.batch_max = len;
 
-	if (! item)
-		return;
+	for (unsigned i = 0; i < len; i++) {
+		const uint8_t response_type = XCB_EVENT_RESPONSE_TYPE(batch[i]);
 
-	focuswin(curws)->monitor = item->data;
+		if (! is_input_event(response_type)) {
+			xcb_window_t win;
 
-	adjust_stacking(focuswin(curws));
-	update_geometry(focuswin(curws), NULL);
+			if (is_barrier_event(response_type))
+				barrier = true;
+			else if ((win = event_window(batch[i])) != XCB_WINDOW_NONE)
+				blocked[nblocked++] = win;
+			continue;
+		}
 
-	xcb_warp_pointer(conn, XCB_WINDOW_NONE, focuswin(curws)->frame,
-			0, 0, 0, 0, 0, 0);
-}
+		/* Keep order, later input of that window stays blocked as well */
+		if (barrier || (nblocked > 0 && client_in(blocked, nblocked,
+						input_client(batch[i]))))
+			continue;
 
-/* Helper function to configure a window. */
-void configure_win(xcb_window_t win, uint16_t mask, winconf_t wc)
-{
-	uint32_t values[7];
-	int i = 0;
+		handle_event(batch[i]);
+		destroy(batch[i]);
+		input = true;
+	}
 
-	uint16_t new_mask = 0;
+	/* Let the user see the result of the input now */
+	apply_steps();
+	if (input)
+		flush(&stats.flush_input);
 
-	if (mask & XCB_CONFIG_WINDOW_X) {
-		new_mask |= XCB_CONFIG_WINDOW_X;
-		values[i++] = wc.x;
-	}
+	for (unsigned i = 0; i < len; i++) {
+		if (batch[i] == NULL)
+			continue;
 
-	if (mask & XCB_CONFIG_WINDOW_Y) {
-		new_mask |= XCB_CONFIG_WINDOW_Y;
-		values[i++] = wc.y;
-	}
+		handle_event(batch[i]);
+		destroy(batch[i]);
 
-	if (mask & XCB_CONFIG_WINDOW_WIDTH) {
-		new_mask |= XCB_CONFIG_WINDOW_WIDTH;
-		values[i++] = wc.width;
+		flush_policy();
 	}
+	apply_steps();
 
-	if (mask & XCB_CONFIG_WINDOW_HEIGHT) {
-		new_mask |= XCB_CONFIG_WINDOW_HEIGHT;
-		values[i++] = wc.height;
-	}
+	if (occlusion_dirty)
+		update_occlusion();
+}
 
-	if (mask & XCB_CONFIG_WINDOW_SIBLING) {
-		new_mask |= XCB_CONFIG_WINDOW_SIBLING;
-		values[i++] = wc.sibling;
-	}
+/*
+ * Handle all X events xcb has for us, batch by batch.
+ *
+ * With queued set, only take those xcb already read from the
+ * connection, e.g. while waiting for a reply, and don't touch the fd.
+ */
+static void handle_x_events(bool queued)
+{
+	xcb_generic_event_t *batch[EVENT_BATCH];
+	xcb_generic_event_t *ev = NULL;
+	bool handled = false;
+	unsigned len;
 
-	if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
-		new_mask |= XCB_CONFIG_WINDOW_STACK_MODE;
-		values[i++] = wc.stackmode;
+	do {
+		for (len = 0; len < EVENT_BATCH; len++) {
+			ev = queued ? xcb_poll_for_queued_event(conn)
+				: xcb_poll_for_event(conn);
+			if (ev == NULL)
+				break;
+			batch[len] = ev;
+		}
+		/* Until the first event we were idle, nothing was waiting */
+		if (len > 0 && ! handled) {
+			last_flush = loop_now();
+			handled = true;
+		}
+		run_batch(batch, len);
+	} while (ev != NULL);
+
+	/*
+	 * Flush after we have handled all queued events. Without any,
+	 * only what timers sent goes out, that's not one of ours.
+	 */
+	if (handled) {
+		flush(&stats.flush_idle);
+	} else {
+		xcb_flush(conn);
+		flush_seq = last_seq;
 	}
 
-	if (i > 0)
-		xcb_configure_window(conn, win, new_mask, values);
+	/*
+	 * Check if we have an unrecoverable connection error,
+	 * like a disconnected X server.
+	 */
+	if (xcb_connection_has_error(conn))
+		cleanup(1);
 }
 
-void events()
+/* X connection is readable */
+static void x_readable(int fd, uint32_t events, void *arg)
 {
-	xcb_generic_event_t *ev = NULL;
-
-	struct pollfd in;			/* poll struct with X fd */
+	(void)fd; (void)events; (void)arg;
+	handle_x_events(false);
+}
 
-	/* Get the file descriptor so we can do poll() on it. */
-	in.fd = xcb_get_file_descriptor(conn);
-	in.events = POLLIN;
+void events()
+{
+	/* Get the file descriptor so we can watch it in the event loop. */
+	const int fd = xcb_get_file_descriptor(conn);
 
-	if (in.fd == -1) {
-		PERROR("Could not connect to xcb file descriptor\n");
+	if (fd == -1 || ! loop_add_fd(fd, EPOLLIN, x_readable, NULL)) {
+		PERROR("Could not watch xcb file descriptor\n");
 		cleanup(1);
 	}
 
 	/* Initial precautios flush */
 	xcb_flush(conn);
+	last_flush = loop_now();
 
 	for (sigcode = 0; sigcode == 0;) {
 		/*
-		 * poll() for incoming events, then use xcb_poll_for_event()
-		 * to get the pending events.
-		 *
-		 * We do it this way instead of xcb_wait_for_event() since
-		 * poll() will return if we were interrupted by a signal.
-		 *
+		 * Events xcb already read while waiting for a reply, e.g.
+		 * in a timer callback, would not make the fd readable again.
 		 */
-		if (poll(&in, 1, -1) == -1) {
-			/* We received a signal. Break out of loop. */
-			if (errno == EINTR)
-				break;
-			perror("wmwm poll()");
-			cleanup(1);
-		}
+		handle_x_events(true);
 
-		/* Get and process next event */
-		while ((ev = xcb_poll_for_event(conn))) {
-			const uint8_t response_type = XCB_EVENT_RESPONSE_TYPE(ev);
-			PDEBUG("  | %s (%d, handled: %d)\n",
-					xcb_event_get_label(response_type),
-					response_type,
-					handler[response_type] ? 1 : 0);
-
-			/* check for RANDR, SHAPE */
-			if (randrbase != -1 && response_type ==
-						(randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY)) {
-				PDEBUG("RANDR screen change notify. Checking outputs.\n");
-				get_randr();
-			} else if (shapebase != -1
-					&& response_type == shapebase + XCB_SHAPE_NOTIFY) {
-				xcb_shape_notify_event_t *sev =
-					(xcb_shape_notify_event_t*) ev;
-
-				set_timestamp(sev->server_time);
-
-				PDEBUG("SHAPE notify (win: 0x%x, shaped: %d)\n",
-						sev->affected_window, sev->shaped);
-				if (sev->shaped) {
-					client_t* client = find_client(sev->affected_window);
-					if (client)
-						update_shape(client);
-				}
-			} else if (handler[response_type]) {
-				handler[response_type](ev);
-			}
-			destroy(ev);
-		}
-
-		/* Flush after we have handled all queued events */
-		xcb_flush(conn);
+		if (sigcode != 0)
+			break;
 
 		/*
-		 * Check if we have an unrecoverable connection error,
-		 * like a disconnected X server.
+		 * Sleep until the X connection, a signal or a timer
+		 * needs us.
 		 */
-		if (xcb_connection_has_error(conn))
+		if (! loop_dispatch()) {
+			perror("wmwm epoll_wait()");
 			cleanup(1);
+		}
 	}
 	PDEBUG("got signal, bailing out!");
 }
@@ -3171,6 +5792,9 @@ void print_x_error(xcb_generic_error_t *e)
 void handle_error_event(xcb_generic_event_t *ev)
 {
 	xcb_generic_error_t *e = (xcb_generic_error_t*) ev;
+
+	if (stack_failed(e))
+		return;
 	print_x_error(e);
 }
 
@@ -3200,9 +5824,14 @@ void handle_property_notify(xcb_generic_event_t *ev)
 			break;
 		case XCB_ATOM_WM_NORMAL_HINTS:
 			icccm_update_wm_normal_hints(client);
+			/* its tile might not fit anymore */
+			if (! (wtree_is_floating(client->wsitem) || client->fullscreen))
+				relayout(client->ws);
 			break;
 		default:
-			if (e->atom == icccm.wm_protocols)
+			/* a new sync counter is only good with the protocol */
+			if (e->atom == icccm.wm_protocols
+					|| e->atom == ewmh->_NET_WM_SYNC_REQUEST_COUNTER)
 				icccm_update_wm_protocols(client);
 			/*else if (e->atom == ewmh->_NET_WM_STATE) {
 				PDEBUG("Atom was _NET_WM_STATE, this shall not happen!\n");
@@ -3230,6 +5859,12 @@ void handle_button_press(xcb_generic_event_t* ev)
 
 	update_timestamp(e->time);
 
+	/* Buttons are meant for the window below the pointer */
+	dwell_commit();
+
+	/* Finish a keyboard preview */
+	outline_commit();
+
 	/* Check if the button is awaited */
 	switch (e->detail) {
 		case 1: case 2: case 3: break;
@@ -3288,11 +5923,13 @@ void handle_button_press(xcb_generic_event_t* ev)
 		return;
 	}
 
-	// if it's a non floating window, just return
-	if (! wtree_is_floating(focuswin(curws)->wsitem))
+	// a tile can only be resized, within its container
+	const bool tiled = ! wtree_is_floating(focuswin(curws)->wsitem);
+	if (tiled && e->detail != 3)
 		return;
-	
-	raise_client(focuswin(curws));
+
+	if (! tiled)
+		raise_client(focuswin(curws));
 
 	switch (e->detail) {
 		case 1: /* left button: move */
@@ -3306,6 +5943,10 @@ void handle_button_press(xcb_generic_event_t* ev)
 					focuswin(curws)->geometry.height);
 			break;
 	}
+	drag.active = ! is_mode(mode_nothing);
+
+	if (conf.outline && ! tiled)
+		outline_show(focuswin(curws), &focuswin(curws)->geometry);
 
 	/*
 	 * Take control of the pointer in the root window
@@ -3348,16 +5989,79 @@ void handle_motion_notify(xcb_generic_event_t *ev)
 	 * Our pointer is moving and since we even get this event
 	 * we're either resizing or moving a window.
 	 */
-	if (is_mode(mode_move))
-		mouse_move(focuswin(curws), e->root_x - mode_x, e->root_y - mode_y);
-	else if (is_mode(mode_resize))
-		mouse_resize(focuswin(curws), e->root_x, e->root_y);
+	if (is_mode(mode_move) || is_mode(mode_resize)) {
+		++stats.drag_motions;
+		drag.x = e->root_x;
+		drag.y = e->root_y;
+		drag.dirty = true;
+
+		/* Apply the first motion right away, later ones on the tick */
+		if (! drag.tick) {
+			drag_apply();
+			drag_start(focuswin(curws));
+		}
+	}
 #ifdef DEBUGMSG
 	else
 		PDEBUG("Motion event when we're not moving our resizing! \n");
 #endif
 }
 
+/* Move or resize the focused window to the latest pointer position. */
+void drag_apply()
+{
+	client_t *client = focuswin(curws);
+
+	if (! drag.dirty)
+		return;
+	drag.dirty = false;
+
+	if (! client || client->fullscreen)
+		return;
+
+	++stats.drag_applied;
+
+	if (is_mode(mode_move))
+		mouse_move(client, drag.x - mode_x, drag.y - mode_y);
+	else if (is_mode(mode_resize))
+		mouse_resize(client, drag.x, drag.y);
+}
+
+/* Refresh of the monitor, apply what the pointer did since the last one. */
+static void drag_tick(void *arg)
+{
+	(void)arg;
+
+	/* Pointer stands still, don't wake up for nothing */
+	if (! drag.dirty || ! (is_mode(mode_move) || is_mode(mode_resize))) {
+		drag_stop();
+		return;
+	}
+	drag_apply();
+}
+
+/* Tick at the refresh rate of the client's monitor while dragging. */
+void drag_start(client_t *client)
+{
+	monitor_t *mon = client ? client->monitor : NULL;
+	uint64_t refresh = DRAG_RATE * 1000;	/* mHz */
+
+	if (mon == NULL && monlist)
+		mon = monlist->data;
+	if (mon && mon->refresh)
+		refresh = mon->refresh;
+
+	const uint64_t interval = 1000000000ull / refresh;
+	drag.tick = loop_timer_add(interval, interval, drag_tick, NULL);
+}
+
+/* Stop ticking. */
+void drag_stop()
+{
+	loop_timer_cancel(drag.tick);
+	drag.tick = 0;
+}
+
 void handle_button_release(xcb_generic_event_t *ev)
 {
 	xcb_button_release_event_t *e =
@@ -3380,6 +6084,23 @@ void handle_button_release(xcb_generic_event_t *ev)
 	}
 
 	xcb_ungrab_pointer(conn, get_timestamp());
+
+	/* Catch up with the pointer, nothing waits for the client after that */
+	drag.active = false;
+	drag_apply();
+	drag_stop();
+
+	/* Now change the window to what was outlined */
+	outline_commit();
+
+	/* Don't wait any longer for the final size */
+	if (focuswin(curws) && focuswin(curws)->sync.counter != XCB_NONE)
+		sync_done(focuswin(curws));
+
+	/* Tell the client where it was dragged to */
+	if (focuswin(curws) && focuswin(curws)->configure_pending)
+		send_configuration(focuswin(curws));
+
 	xcb_flush(conn);	/* Important! */
 
 	set_mode(mode_nothing);
@@ -3406,6 +6127,9 @@ void handle_key_press(xcb_generic_event_t *ev)
 
 	update_timestamp(e->time);
 
+	/* Keys are meant for the window below the pointer */
+	dwell_commit();
+
 	key_enum_t key = key_from_keycode(e->detail);
 
 	client_t *fwin = focuswin(curws);
@@ -3424,6 +6148,13 @@ void handle_key_press(xcb_generic_event_t *ev)
 		return;
 	}
 
+	/* Only another step may be added to the queued steps */
+	if (! ((e->state == MODKEY || e->state == EXTRA_MODKEY)
+				&& key >= KEY_LEFT && key <= KEY_RIGHT)) {
+		apply_steps();
+		outline_commit();
+	}
+
 	switch (e->state) {
 		/* CTRL + META + SHIFT */
 		case EXTRA_MODKEY:
@@ -3454,44 +6185,38 @@ void handle_key_press(xcb_generic_event_t *ev)
 						toggle_tiling(fwin);
 					break;
 
-				case KEY_WS1:
-					move_to_workspace(focuswin(curws), 0);
-					break;
-
-				case KEY_WS2:
-					move_to_workspace(focuswin(curws), 1);
-					break;
-
-				case KEY_WS3:
-					move_to_workspace(focuswin(curws), 2);
+				case KEY_WS1: case KEY_WS2: case KEY_WS3: case KEY_WS4:
+				case KEY_WS5: case KEY_WS6: case KEY_WS7: case KEY_WS8:
+				case KEY_WS9: case KEY_WS10:
+					move_to_workspace(focuswin(curws), key - KEY_WS1);
 					break;
 
-				case KEY_WS4:
-					move_to_workspace(focuswin(curws), 3);
-					break;
-
-				case KEY_WS5:
-					move_to_workspace(focuswin(curws), 4);
-					break;
-
-				case KEY_WS6:
-					move_to_workspace(focuswin(curws), 5);
-					break;
-
-				case KEY_WS7:
-					move_to_workspace(focuswin(curws), 6);
+				default:
 					break;
+			}
+			break;
 
-				case KEY_WS8:
-					move_to_workspace(focuswin(curws), 7);
+		/* CTRL + META + CONTROL */
+		case TAG_MODKEY:
+			switch (key) {
+				case KEY_WS1: case KEY_WS2: case KEY_WS3: case KEY_WS4:
+				case KEY_WS5: case KEY_WS6: case KEY_WS7: case KEY_WS8:
+				case KEY_WS9: case KEY_WS10:
+					tag_toggle(focuswin(curws), key - KEY_WS1);
 					break;
 
-				case KEY_WS9:
-					move_to_workspace(focuswin(curws), 8);
+				default:
 					break;
+			}
+			break;
 
-				case KEY_WS10:
-					move_to_workspace(focuswin(curws), 9);
+		/* CTRL + META + CONTROL + SHIFT */
+		case CONTAINER_MODKEY:
+			switch (key) {
+				case KEY_WS1: case KEY_WS2: case KEY_WS3: case KEY_WS4:
+				case KEY_WS5: case KEY_WS6: case KEY_WS7: case KEY_WS8:
+				case KEY_WS9: case KEY_WS10:
+					move_container_to_workspace(focuswin(curws), key - KEY_WS1);
 					break;
 
 				default:
@@ -3537,6 +6262,9 @@ void handle_key_press(xcb_generic_event_t *ev)
 								tiling_mode = TILING_HORIZONTAL;
 								break;
 							case TILING_HORIZONTAL:
+								tiling_mode = TILING_TABBED;
+								break;
+							case TILING_TABBED:
 								tiling_mode = TILING_VERTICAL;
 								break;
 						}
@@ -3555,11 +6283,11 @@ void handle_key_press(xcb_generic_event_t *ev)
 						if (focuswin(curws)->wsitem->next) {
 							wtree_swap(focuswin(curws)->wsitem,
 									focuswin(curws)->wsitem->next);
-							update_clues(wslist[curws], screen_rect());
+							relayout_tiles(curws, focuswin(curws)->wsitem->parent);
 						} else if (focuswin(curws)->wsitem->prev) {
 							wtree_swap(focuswin(curws)->wsitem,
 									focuswin(curws)->wsitem->prev);
-							update_clues(wslist[curws], screen_rect());
+							relayout_tiles(curws, focuswin(curws)->wsitem->parent);
 						}
 					}
 					break;
@@ -3568,44 +6296,10 @@ void handle_key_press(xcb_generic_event_t *ev)
 					toggle_fullscreen(focuswin(curws));
 					break;
 
-				case KEY_WS1:
-					change_workspace(0);
-					break;
-
-				case KEY_WS2:
-					change_workspace(1);
-					break;
-
-				case KEY_WS3:
-					change_workspace(2);
-					break;
-
-				case KEY_WS4:
-					change_workspace(3);
-					break;
-
-				case KEY_WS5:
-					change_workspace(4);
-					break;
-
-				case KEY_WS6:
-					change_workspace(5);
-					break;
-
-				case KEY_WS7:
-					change_workspace(6);
-					break;
-
-				case KEY_WS8:
-					change_workspace(7);
-					break;
-
-				case KEY_WS9:
-					change_workspace(8);
-					break;
-
-				case KEY_WS10:
-					change_workspace(9);
+				case KEY_WS1: case KEY_WS2: case KEY_WS3: case KEY_WS4:
+				case KEY_WS5: case KEY_WS6: case KEY_WS7: case KEY_WS8:
+				case KEY_WS9: case KEY_WS10:
+					change_workspace(key - KEY_WS1);
 					break;
 
 				case KEY_TOPLEFT:
@@ -3712,17 +6406,32 @@ void handle_enter_notify(xcb_generic_event_t *ev)
 		return;
 	}
 
+	/* The pointer didn't move, we moved windows below it */
+	if (layout_caused(ev)) {
+		PDEBUG("Enter notify caused by layout change, ignored.\n");
+		++stats.enter_ignored;
+		return;
+	}
+
 	/*
 	 * If we're entering the same window we focus now
 	 * or cannot find a client, then don't bother focusing.
 	 */
 	client_t *client = find_clientp(e->event);
-	if (! client || client == focuswin(curws))
+	if (! client || client == focuswin(curws)) {
+		/* back where it was, the others were only passed */
+		dwell_cancel();
 		return;
+	}
+
 	/*
-	 * Set focus to the window we just entered.
+	 * Set focus to the window we just entered, or if we are
+	 * supposed to wait, once the pointer stayed there.
 	 */
-	set_focus(client);
+	if (conf.focusdelay)
+		dwell_start(client);
+	else
+		set_focus(client);
 }
 
 void handle_configure_notify(xcb_generic_event_t *ev)
@@ -3810,26 +6519,39 @@ void handle_configure_request(xcb_generic_event_t *ev)
 		apply_gravity(client, &geometry);
 		/* Check if window fits on screen after resizing. */
 		update_geometry(client, &geometry);
+	} else if (e->value_mask & (XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y
+				| XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT)) {
+		/*
+		 * Its tile already fits its hints, tell it where it is
+		 * instead, or it keeps asking.
+		 */
+		send_configuration(client);
 	}
 
 	/* Handle sibling/stacking order separately */
 	const uint16_t mask = e->value_mask &
 		(XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE);
 
-	if (mask) {
-		int i = 0;
-		uint32_t values[2];
-		if (mask & XCB_CONFIG_WINDOW_SIBLING) {
-			PDEBUG("configure request : sibling 0x%x\n", e->sibling);
-			client_t *sibling = find_client(e->sibling);
-			/* replace sibling with its frame if it's ours */
-			values[i++] = sibling ? sibling->frame : e->sibling;
-		}
-		if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
-			PDEBUG("configure request : stack mode\n");
-			values[i++] = e->stack_mode;
+	/*
+	 * It's raised or lowered within its layer, a sibling isn't
+	 * honored. Other modes depend on what's covered, they are
+	 * ignored.
+	 */
+	if (mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+		PDEBUG("configure request : stack mode %u\n", e->stack_mode);
+		switch (e->stack_mode) {
+			case XCB_STACK_MODE_ABOVE:
+				raise_client(client);
+				break;
+			case XCB_STACK_MODE_BELOW:
+				lower_client(client);
+				break;
+			case XCB_STACK_MODE_OPPOSITE:
+				raise_or_lower_client(client);
+				break;
+			default:
+				break;
 		}
-		xcb_configure_window(conn, client->frame, mask, values);
 	}
 }
 
@@ -3849,6 +6571,12 @@ static void handle_client_message(xcb_generic_event_t *ev)
 		return;
 	}
 
+	/* Pager wants to see another workspace */
+	if (e->type == ewmh->_NET_CURRENT_DESKTOP) {
+		change_workspace(e->data.data32[0]);
+		return;
+	}
+
 	/* Don't act on messages from unhandled windows */
 	if (! client) {
 		PDEBUG("client_message - unknown window (0x%x)\n", e->window);
@@ -3887,6 +6615,12 @@ static void handle_client_message(xcb_generic_event_t *ev)
 		return;
 	}
 
+	/* Pager moves the window to another workspace */
+	if (e->type == ewmh->_NET_WM_DESKTOP) {
+		move_to_workspace(client, e->data.data32[0]);
+		return;
+	}
+
 	/* Close window */
 	if (e->type == ewmh->_NET_CLOSE_WINDOW) {
 		delete_win(client);
@@ -3950,12 +6684,21 @@ void handle_circulate_request(xcb_generic_event_t *ev)
 
 	/*
 	 * Subwindow e->window to parent e->event is about to be
-	 * restacked.
-	 *
-	 * Just do what was requested, e->place is either
-	 * XCB_PLACE_ON_TOP or _ON_BOTTOM. We don't care.
+	 * restacked, e->place is either XCB_PLACE_ON_TOP or _ON_BOTTOM.
+	 * Ours stay in their layer, others get what they asked for.
 	 */
-	xcb_circulate_window(conn, e->window, e->place);
+	client_t *client = find_clientp(e->window);
+	if (client) {
+		if (e->place == XCB_PLACE_ON_TOP)
+			raise_client(client);
+		else
+			lower_client(client);
+		return;
+	}
+
+	const uint32_t values[] = { e->place == XCB_PLACE_ON_TOP
+		? XCB_STACK_MODE_ABOVE : XCB_STACK_MODE_BELOW };
+	xcb_configure_window(conn, e->window, XCB_CONFIG_WINDOW_STACK_MODE, values);
 }
 
 void handle_mapping_notify(xcb_generic_event_t *ev)
@@ -4053,10 +6796,13 @@ void handle_destroy_notify(xcb_generic_event_t *ev)
 
 void print_help()
 {
-	printf("Usage: wmwm [-b width] [-t terminal] [-m menu]"
+	printf("Usage: wmwm [-b width] [-d ms] [-n] [-o] [-t terminal] [-m menu]"
 			"[-f color] [-F color] [-x color] [-X color]\n");
 	printf("\n");
 	printf("  -b width\tborder width\n");
+	printf("  -d ms\t\tfocus window after pointer stayed ms over it\n");
+	printf("  -n\t\tdon't reparent, only shaped windows get a frame\n");
+	printf("  -o\t\tmove and resize windows as outline\n");
 	printf("  -t terminal\tstart terminal with MODKEY + Return\n");
 	printf("  -m menu\tstart menu with MODKEY + m\n");
 	printf("  -f color\tfocused window border color\n");
@@ -4066,9 +6812,56 @@ void print_help()
 	printf("\n");
 }
 
-void signal_catch(int sig)
+void print_stats()
+{
+	fprintf(stderr, "wmwm: batches: %" PRIu64 ", events: %" PRIu64
+			" (avg %.1f, max %u)\n",
+			stats.batches, stats.batch_events,
+			stats.batches ? (double)stats.batch_events / stats.batches : 0.0,
+			stats.batch_max);
+	fprintf(stderr, "wmwm: flushes: %" PRIu64 " (input %" PRIu64
+			", budget %" PRIu64 ", requests %" PRIu64 ", idle %" PRIu64 ")\n",
+			stats.flushes, stats.flush_input, stats.flush_budget,
+			stats.flush_requests, stats.flush_idle);
+	fprintf(stderr, "wmwm: flush interval: avg %" PRIu64 " us, max %" PRIu64 " us\n",
+			stats.flushes ? stats.flush_interval / stats.flushes : 0,
+			stats.flush_interval_max);
+	fprintf(stderr, "wmwm: steps: %" PRIu64 ", applied: %" PRIu64
+			", raises skipped: %" PRIu64 "\n",
+			stats.steps, stats.steps_applied, stats.raises_skipped);
+	fprintf(stderr, "wmwm: drag motions: %" PRIu64 ", applied: %" PRIu64 "\n",
+			stats.drag_motions, stats.drag_applied);
+	fprintf(stderr, "wmwm: layouts: %" PRIu64 ", deferred: %" PRIu64 "\n",
+			stats.layouts, stats.layouts_deferred);
+	fprintf(stderr, "wmwm: tiles concealed: %" PRIu64
+			", layout changes deferred: %" PRIu64
+			", windows obscured: %" PRIu64 "\n",
+			stats.concealed, stats.tiles_deferred, stats.obscured);
+	fprintf(stderr, "wmwm: frames from pool: %" PRIu64
+			", created: %" PRIu64 "\n",
+			stats.frame_hits, stats.frame_misses);
+	fprintf(stderr, "wmwm: enter events ignored: %" PRIu64
+			", focus changes avoided: %" PRIu64 "\n",
+			stats.enter_ignored, stats.focus_avoided);
+}
+
+void handle_signal(int sig, void *arg)
 {
-	sigcode = sig;
+	(void)arg;
+
+	switch (sig) {
+		case SIGCHLD:
+			/* Reap all our children. Don't create zombies. */
+			while (waitpid(-1, NULL, WNOHANG) > 0);
+			break;
+		case SIGUSR1:
+			print_stats();
+			break;
+		default:
+			/* Make events() bail out */
+			sigcode = sig;
+			break;
+	}
 }
 
 /*
@@ -4158,21 +6951,12 @@ int main(int argc, char **argv)
 
 	ewmh = NULL;
 
-	/* Install signal handlers. */
-
-	/* We ignore child exists. Don't create zombies. */
-	if (SIG_ERR == signal(SIGCHLD, SIG_IGN)) {
-		perror("wmwm: signal");
-		exit(1);
-	}
-
-	if (SIG_ERR == signal(SIGINT, signal_catch)) {
-		perror("wmwm: signal");
-		exit(1);
-	}
-
-	if (SIG_ERR == signal(SIGTERM, signal_catch)) {
-		perror("wmwm: signal");
+	/*
+	 * Set up the event loop. Our signals are blocked from now on and
+	 * delivered via the loop.
+	 */
+	if (! loop_init(signals, sizeof(signals)/sizeof(int), handle_signal, NULL)) {
+		perror("wmwm: loop");
 		exit(1);
 	}
 
@@ -4183,10 +6967,13 @@ int main(int argc, char **argv)
 	conf.terminal = TERMINAL;
 	conf.menu = MENU;
 	conf.allowicons = ALLOWICONS;
+	conf.outline = OUTLINE;
+	conf.reparent = REPARENT;
+	conf.focusdelay = FOCUS_DELAY;
 	focuscol = FOCUSCOL;
 	unfocuscol = UNFOCUSCOL;
 
-	while ((ch = getopt(argc, argv, "b:it:m:f:F:x:X:")) != -1) {
+	while ((ch = getopt(argc, argv, "b:d:inot:m:f:F:x:X:")) != -1) {
 		switch (ch) {
 			case 'b':
 				conf.borderwidth = atoi(optarg);
@@ -4197,6 +6984,15 @@ int main(int argc, char **argv)
 			case 'i':
 				conf.allowicons = true;
 				break;
+			case 'n':
+				conf.reparent = false;
+				break;
+			case 'o':
+				conf.outline = true;
+				break;
+			case 'd':
+				conf.focusdelay = atoi(optarg);
+				break;
 			case 't':
 				conf.terminal = optarg;
 				break;
@@ -4262,6 +7058,15 @@ int main(int argc, char **argv)
 	/* Check for SHAPE extension */
 	shapebase = setup_shape();
 
+	/* Frames for the first windows */
+	setup_framepool();
+
+	/* Get SYNC for _NET_WM_SYNC_REQUEST */
+	syncbase = setup_sync();
+
+	if (conf.outline)
+		setup_outline();
+
 
 	/* Loop over all clients and set up stuff. */
 	if (! setup_screen()) {
@@ -4331,17 +7136,18 @@ void focus_next()
 			return;
 		node = wtree_next(focuswin(curws)->wsitem);
 	}
-	if (node == NULL)
-		node = wtree_next(wslist[curws]);
+	if (node == NULL && ws_root(curws))
+		node = wtree_next(ws_root(curws));
 
 	if (node) {
 		client_t *client = wtree_client(node);
+		/* focus first, that shows it if it's an inactive tab */
+		set_focus(client);
 		if (! pointer_over_client(client))
 			xcb_warp_pointer(conn, XCB_WINDOW_NONE, client->id,
 					0, 0, 0, 0,
 					client->geometry.width / 2,
 					client->geometry.height / 2);
-		set_focus(client);
 	}
 }
 
@@ -4355,6 +7161,8 @@ void focus_under_cursor()
 			xcb_query_pointer(conn, screen->root), 0);
 	if (pointer) {
 		win = pointer->child;
+		/* the monitor the pointer is on gets current */
+		focus_monitor(find_monitor_at(pointer->root_x, pointer->root_y));
 		destroy(pointer);
 	} else {
 		PDEBUG("Did not find window under cursor.\n");
@@ -4362,6 +7170,56 @@ void focus_under_cursor()
 	set_focus(find_clientp(win));
 }
 
+/* Focus client once the pointer stayed over it for conf.focusdelay. */
+void dwell_start(client_t *client)
+{
+	dwell_cancel();
+
+	dwell.client = client;
+	dwell.timer = loop_timer_add(conf.focusdelay * 1000, 0,
+			dwell_timeout, NULL);
+
+	/* no timer, no delay */
+	if (dwell.timer == 0)
+		dwell_commit();
+}
+
+/* Forget the window the pointer was over, it didn't stay. */
+void dwell_cancel()
+{
+	if (dwell.client == NULL)
+		return;
+
+	++stats.focus_avoided;
+	loop_timer_cancel(dwell.timer);
+	dwell.timer = 0;
+	dwell.client = NULL;
+}
+
+static void dwell_timeout(void *arg)
+{
+	(void)arg;
+	dwell.timer = 0;
+	dwell_commit();
+}
+
+/* Focus the window the pointer is over now. */
+void dwell_commit()
+{
+	client_t *client = dwell.client;
+
+	if (client == NULL)
+		return;
+
+	loop_timer_cancel(dwell.timer);
+	dwell.timer = 0;
+	dwell.client = NULL;
+
+	/* It might have gone elsewhere meanwhile */
+	if (client->ws == curws && ! client->hidden && client != focuswin(curws))
+		set_focus(client);
+}
+
 /* apply client's gravity to given geometry */
 void apply_gravity(client_t *client, xcb_rectangle_t* geometry)
 {
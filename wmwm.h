@@ -4,13 +4,25 @@
 #include <stdbool.h>        // for bool
 #include <stdint.h>         // for uint16_t, int16_t, uint8_t
 #include <xcb/randr.h>      // for xcb_randr_output_t
+#include <xcb/sync.h>       // for xcb_sync_counter_t, xcb_sync_alarm_t
 #include <xcb/xcb_icccm.h>  // for xcb_size_hints_t
 #include <xcb/xproto.h>     // for xcb_drawable_t, xcb_rectangle_t, xcb_colo...
 #include "list.h"           // for list_t
 #include "tree.h"
+#include "loop.h"           // for loop_timer_t
 
-/* Number of workspaces. */
+/* Number of workspaces with keys, more are made on demand. */
 #define WORKSPACES 10u
+/* Most workspaces we make, e.g. when asked by a pager. */
+#define WORKSPACES_MAX 4096u
+
+/* Workspaces a window can be on at once, they are bits of client->tags. */
+#define TAGS 64u
+#define TAG(ws) ((ws) < TAGS ? (uint64_t)1 << (ws) : 0)
+
+/* Reasons for a tile's frame to be unmapped, see client->conceal. */
+#define CONCEAL_OCCLUDED	(1u << 0)	/* covered by a fullscreen window */
+#define CONCEAL_TAB			(1u << 1)	/* inactive tab of a tabbed container */
 
 /* Types. */
 /* All our key shortcuts. */
@@ -57,6 +69,9 @@ typedef struct monitor {
 	int16_t y;
 	uint16_t width;				/* Width in pixels. */
 	uint16_t height;			/* Height in pixels. */
+	uint32_t refresh;			/* Refresh rate in mHz, 0 if unknown. */
+	uint32_t ws;				/* Workspace shown on it. */
+	list_t *clients;			/* Clients on it, see client->monitem. */
 
 	list_t *item;				/* Pointer to our place in output list. */
 } monitor_t;
@@ -84,14 +99,39 @@ typedef struct client {
 	bool vertmaxed;					/* Vertically maximized, borders */
 	bool fullscreen;				/* Fullscreen, i.e. without border */
 	bool hidden;					/* Currently hidden */
+	uint8_t conceal;				/* CONCEAL_* reasons, frame unmapped if any */
+	bool obscured;					/* Covered by any window, _NET_WM_STATE_HIDDEN */
+	uint32_t stacked;				/* Higher is above, see stack_number() */
+	list_t *stackitem;				/* Our place in stacklist */
+	bool tile_pending;				/* tile waits for it to be revealed */
+	xcb_rectangle_t tile;			/* Geometry of its tile while concealed */
 	int killed;						/* number of times we sent delete_window message */
 
 	bool ignore_unmap;				/* unmap_notification we shall ignore */
+	bool configure_pending;			/* moved without telling it, see send_configuration */
+
+	/* _NET_WM_SYNC_REQUEST, pacing interactive resizes */
+	struct {
+		xcb_sync_counter_t counter;	/* client's counter, XCB_NONE if none */
+		xcb_sync_alarm_t alarm;		/* fires when counter reaches value */
+		uint64_t value;				/* last value we asked for */
+		bool request;				/* ask before the next resize */
+		bool waiting;				/* client hasn't caught up yet */
+		bool pending;				/* geometry waits for the client */
+		xcb_rectangle_t geometry;	/* geometry waiting for the client */
+		loop_timer_t timeout;		/* give up waiting */
+	} sync;
 
 	monitor_t *monitor;				/* The physical output this window is on. */
+	list_t *monitem;				/* Our place in monitor->clients. */
 	/* XXX tiling: set after create_client */
 
-	/* XXX tiling: make this an array to have multitags */
+	/*
+	 * A window is on all workspaces of tags, with a node in each of
+	 * their trees. It's shown on ws, as wsitem there.
+	 */
+	uint64_t tags;					/* TAG() of all its workspaces */
+	tree_t **tagitems;				/* Its nodes by bit of tags, NULL if one */
 	tree_t *wsitem;	/* Pointer to our place in workspaces
 									   window tree. */
 	uint32_t ws;